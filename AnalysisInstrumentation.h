@@ -0,0 +1,208 @@
+/*
+  ==============================================================================
+
+    AnalysisInstrumentation.h
+    Counters and histograms for what the tuner costs in a live session:
+    processBlock time, FFTs per analysis pass, what viewTopAndNext saw,
+    how often the sample FIFO or the FFT frame pool was full, and what the
+    overload policy did about it.
+
+    Every counter has exactly 1 writer (the audio thread, or the analysis
+    thread for the ones runAnalysis records), so an update is a relaxed
+    load + store. No locks and no compare-and-swap loops: wait-free.
+    Any thread can take a Snapshot. The counters are read one at a time,
+    so a snapshot can be a hop out of date in places. Fine for a display.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+class AnalysisInstrumentation
+{
+public:
+    static constexpr int numDurationBuckets = 16; //bucket 0 is under 1us, bucket b is [2^(b-1), 2^b) us, the last one is everything from 16ms up
+    static constexpr int numFFTCountBuckets = 9; //0..7 FFTs in a pass, the last one is 8 or more
+
+    struct Snapshot
+    {
+        juce::int64 numBlocks = 0;
+        juce::int64 totalBlockNanoseconds = 0;
+        juce::int64 maxBlockNanoseconds = 0;
+        std::array<juce::int64, numDurationBuckets> blockDurationHistogram {};
+
+        juce::int64 numAnalysisPasses = 0; //1 per processBlock, or 1 per poll of the background thread
+        juce::int64 numFFTs = 0; //FFT phase vocoder frames, every channel
+        std::array<juce::int64, numFFTCountBuckets> fftsPerPassHistogram {};
+        juce::int64 numTrackerReadings = 0; //readings from the sliding DFT instead of an FFT
+        juce::int64 numZoomChecks = 0; //phase vocoder readings cross-checked with the zoom transform (setZoomCrossCheck)
+        juce::int64 numZoomDisagreements = 0; //of those, how many were too far from it, so their confidence was cut
+        std::array<juce::int64, 3> viewTopAndNextOutcomes {}; //how often it saw 0, 1 or 2 frames
+
+        juce::int64 numDroppedBlocks = 0; //the sample FIFO was full, so a whole host block was dropped
+        juce::int64 numDroppedFrames = 0; //the frame pool was full, so an FFT was skipped
+        
+        juce::int64 numGaps = 0; //holes in the stream (dropped blocks or dropped backlog). The estimators started again after each one
+        juce::int64 numDiscardedSamples = 0; //backlog thrown away by OverloadPolicy::dropOldest
+        juce::int64 numCoalescedHops = 0; //backlog hops that only went into the history (OverloadPolicy::coalesceToLatest)
+        juce::int64 numSkippedHops = 0; //the same, for OverloadPolicy::skipAnalysisUntilCaughtUp
+
+        double getAverageBlockMicroseconds() const
+        {
+            return (numBlocks > 0) ? 1.0e-3*totalBlockNanoseconds/numBlocks : 0.0;
+        }
+
+        double getAverageFFTsPerPass() const
+        {
+            return (numAnalysisPasses > 0) ? static_cast<double>(numFFTs)/numAnalysisPasses : 0.0;
+        }
+
+        //The upper edge of the bucket the percentile falls in, so "fraction of the blocks took less than this"
+        double getBlockMicrosecondsPercentile(double fraction) const
+        {
+            juce::int64 total = 0;
+            for (auto count : blockDurationHistogram)
+            {
+                total += count;
+            }
+
+            const double wanted = fraction*total;
+            juce::int64 runningTotal = 0;
+            for (int bucket = 0; bucket < numDurationBuckets; ++bucket)
+            {
+                runningTotal += blockDurationHistogram[static_cast<size_t>(bucket)];
+                if (runningTotal >= wanted)
+                {
+                    return static_cast<double>(1 << bucket);
+                }
+            }
+            return static_cast<double>(1 << (numDurationBuckets-1));
+        }
+    };
+
+    //Only when nobody is writing (prepareToPlay)
+    void reset()
+    {
+        for (auto* counter : { &numBlocks, &totalBlockNanoseconds, &maxBlockNanoseconds, &numAnalysisPasses,
+                               &numFFTs, &numTrackerReadings, &numZoomChecks, &numZoomDisagreements, &numDroppedBlocks, &numDroppedFrames,
+                               &numGaps, &numDiscardedSamples, &numCoalescedHops, &numSkippedHops })
+        {
+            counter->store(0, std::memory_order_relaxed);
+        }
+        for (auto& bucket : blockDurationHistogram) { bucket.store(0, std::memory_order_relaxed); }
+        for (auto& bucket : fftsPerPassHistogram) { bucket.store(0, std::memory_order_relaxed); }
+        for (auto& outcome : viewTopAndNextOutcomes) { outcome.store(0, std::memory_order_relaxed); }
+        fftsThisPass = 0;
+    }
+
+    //Audio thread, once per processBlock
+    void recordBlock(juce::int64 nanoseconds, bool sampleFifoAcceptedBlock)
+    {
+        increment(numBlocks);
+        increment(totalBlockNanoseconds, nanoseconds);
+        if (nanoseconds > maxBlockNanoseconds.load(std::memory_order_relaxed))
+        {
+            maxBlockNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+        }
+
+        int bucket = 0;
+        for (juce::int64 microseconds = nanoseconds/1000; microseconds > 0 && bucket < numDurationBuckets-1; microseconds >>= 1)
+        {
+            ++bucket;
+        }
+        increment(blockDurationHistogram[static_cast<size_t>(bucket)]);
+
+        if (! sampleFifoAcceptedBlock)
+        {
+            increment(numDroppedBlocks);
+        }
+    }
+
+    //Whichever thread runs the analysis
+    void recordFFT(bool frameWasProduced)
+    {
+        if (frameWasProduced)
+        {
+            increment(numFFTs);
+            ++fftsThisPass;
+        }
+        else
+        {
+            increment(numDroppedFrames);
+        }
+    }
+
+    void recordViewTopAndNext(int numFramesSeen)
+    {
+        jassert(numFramesSeen >= 0 && numFramesSeen <= 2);
+        increment(viewTopAndNextOutcomes[static_cast<size_t>(numFramesSeen)]);
+    }
+
+    void recordTrackerReading() { increment(numTrackerReadings); }
+    void recordZoomCheck(bool agreedWithPhaseDifference)
+    {
+        increment(numZoomChecks);
+        if (! agreedWithPhaseDifference)
+        {
+            increment(numZoomDisagreements);
+        }
+    }
+    void recordGap() { increment(numGaps); }
+    void recordDiscardedSamples(juce::int64 numSamples) { increment(numDiscardedSamples, numSamples); }
+    void recordSkippedHop(bool coalesced) { increment(coalesced ? numCoalescedHops : numSkippedHops); }
+
+    void endAnalysisPass()
+    {
+        increment(numAnalysisPasses);
+        increment(fftsPerPassHistogram[static_cast<size_t>(juce::jmin(fftsThisPass, numFFTCountBuckets-1))]);
+        fftsThisPass = 0;
+    }
+
+    //Any thread
+    Snapshot getSnapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.numBlocks = numBlocks.load(std::memory_order_relaxed);
+        snapshot.totalBlockNanoseconds = totalBlockNanoseconds.load(std::memory_order_relaxed);
+        snapshot.maxBlockNanoseconds = maxBlockNanoseconds.load(std::memory_order_relaxed);
+        snapshot.numAnalysisPasses = numAnalysisPasses.load(std::memory_order_relaxed);
+        snapshot.numFFTs = numFFTs.load(std::memory_order_relaxed);
+        snapshot.numTrackerReadings = numTrackerReadings.load(std::memory_order_relaxed);
+        snapshot.numZoomChecks = numZoomChecks.load(std::memory_order_relaxed);
+        snapshot.numZoomDisagreements = numZoomDisagreements.load(std::memory_order_relaxed);
+        snapshot.numDroppedBlocks = numDroppedBlocks.load(std::memory_order_relaxed);
+        snapshot.numDroppedFrames = numDroppedFrames.load(std::memory_order_relaxed);
+        snapshot.numGaps = numGaps.load(std::memory_order_relaxed);
+        snapshot.numDiscardedSamples = numDiscardedSamples.load(std::memory_order_relaxed);
+        snapshot.numCoalescedHops = numCoalescedHops.load(std::memory_order_relaxed);
+        snapshot.numSkippedHops = numSkippedHops.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < blockDurationHistogram.size(); ++i) { snapshot.blockDurationHistogram[i] = blockDurationHistogram[i].load(std::memory_order_relaxed); }
+        for (size_t i = 0; i < fftsPerPassHistogram.size(); ++i) { snapshot.fftsPerPassHistogram[i] = fftsPerPassHistogram[i].load(std::memory_order_relaxed); }
+        for (size_t i = 0; i < viewTopAndNextOutcomes.size(); ++i) { snapshot.viewTopAndNextOutcomes[i] = viewTopAndNextOutcomes[i].load(std::memory_order_relaxed); }
+        return snapshot;
+    }
+
+private:
+    //Single writer, so there's no need for an atomic read-modify-write (fetch_add is a locked instruction on x86)
+    static void increment(std::atomic<juce::int64>& counter, juce::int64 amount = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::atomic<juce::int64> numBlocks {0}, totalBlockNanoseconds {0}, maxBlockNanoseconds {0};
+    std::array<std::atomic<juce::int64>, numDurationBuckets> blockDurationHistogram {};
+
+    std::atomic<juce::int64> numAnalysisPasses {0}, numFFTs {0}, numTrackerReadings {0};
+    std::atomic<juce::int64> numZoomChecks {0}, numZoomDisagreements {0};
+    std::array<std::atomic<juce::int64>, numFFTCountBuckets> fftsPerPassHistogram {};
+    std::array<std::atomic<juce::int64>, 3> viewTopAndNextOutcomes {};
+    int fftsThisPass = 0; //only the analysis side touches this
+
+    std::atomic<juce::int64> numDroppedBlocks {0}, numDroppedFrames {0};
+    std::atomic<juce::int64> numGaps {0}, numDiscardedSamples {0}, numCoalescedHops {0}, numSkippedHops {0}; //analysis side
+};
@@ -0,0 +1,269 @@
+/*
+  ==============================================================================
+
+    Headless batch pitch analyzer.
+    Runs recorded takes through the same AudioBufferFifo -> FFTDataGenerator ->
+    findExactMaxFrequency chain the plugin uses, as fast as the CPU allows.
+
+    Usage: ChromaticTunerBatch [options] file1.wav file2.aiff ...
+        --rate N       readings per second (default 50)
+        --overlap F    use an FFT overlap fraction instead of --rate, eg. 0.75 (hop = FFT length/4)
+        --estimator E  fft (default), mpm (McLeod pitch method, shorter window) or pyramid (octave pyramid, down to 27.5 Hz)
+        --adaptive     pick the FFT order (2048/4096/8192) from the detected pitch instead of always 8192
+        --ref Hz       reference frequency for A4 (default 440)
+        --temperament T  equal (default), pythagorean, meantone, just or werckmeister3
+        --key K        the key the temperament is built on, 0 = C (default) ... 11 = B
+        --stretch C    stretch tuning, cents per octave away from A4 (default 0)
+        --threads N    number of worker threads (default = number of CPUs)
+        --out DIR      directory for the .pitch.csv files (default = next to each input file)
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+struct BatchSettings
+{
+    double analysisRate = SimpleTunerAudioProcessor::defaultAnalysisRate;
+    float analysisOverlap = 0.f; //0 means use analysisRate
+    bool adaptiveFFTOrder = false;
+    SimpleTunerAudioProcessor::EstimatorType estimatorType = SimpleTunerAudioProcessor::EstimatorType::fftPhaseVocoder;
+    float referenceFrequency = 440.f;
+    NoteMapper::Temperament temperament = NoteMapper::equal;
+    int temperamentKey = 0;
+    float stretchCentsPerOctave = 0.f;
+    int numThreads = juce::SystemStats::getNumCpus();
+    juce::File outputDirectory; //if this doesn't exist, the csv is written next to the input
+};
+
+struct FileAnalysisResult
+{
+    juce::String fileName;
+    bool succeeded = false;
+    juce::String errorMessage;
+    double audioSeconds = 0;
+    double processingSeconds = 0;
+    int numFrames = 0;
+};
+
+class FileAnalysisJob : public juce::ThreadPoolJob
+{
+public:
+    FileAnalysisJob(const juce::File& fileToAnalyze, const BatchSettings& batchSettings, FileAnalysisResult& resultToFill)
+        : juce::ThreadPoolJob(fileToAnalyze.getFileName()),
+          file(fileToAnalyze),
+          settings(batchSettings),
+          result(resultToFill)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        result.fileName = file.getFileName();
+
+        //Every job has its own format manager and processor, so nothing is shared between threads
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats(); //WAV, AIFF (+ FLAC, Ogg, etc. depending on the JUCE config)
+
+        std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor(file));
+        if (reader == nullptr)
+        {
+            result.errorMessage = "could not open file";
+            return jobHasFinished;
+        }
+
+        juce::File outputFile = settings.outputDirectory.isDirectory()
+                                    ? settings.outputDirectory.getChildFile(file.getFileNameWithoutExtension() + ".pitch.csv")
+                                    : file.withFileExtension(".pitch.csv");
+        juce::FileOutputStream csv (outputFile);
+        if (! csv.openedOk())
+        {
+            result.errorMessage = "could not write " + outputFile.getFullPathName();
+            return jobHasFinished;
+        }
+        csv.setPosition(0);
+        csv.truncate();
+        csv << "time_s,frequency_hz,note,cents,magnitude_db,confidence\n";
+
+        const double sampleRate = reader->sampleRate;
+
+        //The processor is driven exactly like a host would drive it
+        SimpleTunerAudioProcessor processor;
+        processor.setAdaptiveFFTOrder(settings.adaptiveFFTOrder);
+        NoteMapper noteMapper;
+        noteMapper.setReferenceFrequency(settings.referenceFrequency);
+        noteMapper.setTemperament(settings.temperament, settings.temperamentKey);
+        noteMapper.setStretch(settings.stretchCentsPerOctave);
+        processor.setNoteMapper(noteMapper);
+        processor.setEstimatorType(settings.estimatorType);
+        if (settings.analysisOverlap > 0.f)
+        {
+            processor.setAnalysisOverlap(settings.analysisOverlap);
+        }
+        else
+        {
+            processor.setAnalysisRate(settings.analysisRate);
+        }
+
+        //The hop is never more than masterFFTLength/4, so that's a safe max block size.
+        //Then we feed one hop per block, so every block gives at most one reading. Not every hop gives one (eg. while the
+        //adaptive order switches, or the first hops after a gap), so only the blocks that published a new reading get a row
+        processor.setRateAndBufferSizeDetails(sampleRate, processor.masterFFTLength/4);
+        processor.prepareToPlay(sampleRate, processor.masterFFTLength/4);
+        const int blockSize = processor.getAnalysisHopSize();
+
+        juce::AudioBuffer<float> block (1, blockSize); //The plugin only analyses channel 0, so that's all we read
+        juce::MidiBuffer midi;
+
+        juce::uint32 lastVersion = 0;
+        processor.getCurrentReading(0, &lastVersion);
+
+        const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        for (juce::int64 position = 0; position < reader->lengthInSamples; position += blockSize)
+        {
+            const int numToRead = static_cast<int>( juce::jmin<juce::int64>(blockSize, reader->lengthInSamples - position) );
+            block.clear();
+            reader->read(&block, 0, numToRead, position, true, false); //useLeftChannel, useRightChannel
+
+            processor.processBlock(block, midi);
+
+            juce::uint32 version = 0;
+            const TunerReading reading = processor.getCurrentReading(0, &version); //the processor already mapped it to a note
+            if (version == lastVersion)
+            {
+                continue; //no new reading from this block, the last one already has its row
+            }
+            lastVersion = version;
+            if (reading.frequency < 0.f)
+            {
+                continue; //-1 means there haven't been two FFT frames yet
+            }
+
+            //Time of the newest sample in the analysis window, straight from the frame the reading came from
+            const double frameTime = static_cast<double>(reading.sampleTime) / sampleRate;
+            const float magnitudeDB = juce::Decibels::gainToDecibels(reading.peakMagnitude/reading.windowLength);
+
+            csv << juce::String(frameTime, 6) << "," << juce::String(reading.frequency, 3) << ",";
+
+            if (reading.hasPitch())
+            {
+                csv << NoteMapper::getNoteLetter(reading.noteIndex) << (NoteMapper::isSharp(reading.noteIndex) ? "#" : "") << "," << juce::String(reading.cents, 2);
+            }
+            else
+            {
+                csv << ","; //below the noise threshold: no note, no cents
+            }
+            csv << "," << juce::String(magnitudeDB, 2) << "," << juce::String(reading.confidence, 2) << "\n";
+            ++result.numFrames;
+        }
+
+        result.processingSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime)/1000.0;
+        result.audioSeconds = reader->lengthInSamples/sampleRate;
+        result.succeeded = true;
+
+        return jobHasFinished;
+    }
+
+private:
+    juce::File file;
+    const BatchSettings& settings;
+    FileAnalysisResult& result;
+};
+
+static void printUsage()
+{
+    std::cout << "Usage: ChromaticTunerBatch [--rate N | --overlap F] [--estimator fft|mpm|pyramid] [--adaptive] [--ref Hz] [--temperament T] [--key K] [--stretch C] [--threads N] [--out DIR] files..." << std::endl;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    BatchSettings settings;
+    juce::Array<juce::File> filesToAnalyze;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg (argv[i]);
+        const bool hasValue = (i+1 < argc);
+
+        if (arg == "--rate" && hasValue)         { settings.analysisRate = juce::jmax(1.0, juce::String(argv[++i]).getDoubleValue()); }
+        else if (arg == "--overlap" && hasValue) { settings.analysisOverlap = juce::jlimit(0.f, 0.99f, juce::String(argv[++i]).getFloatValue()); }
+        else if (arg == "--adaptive")            { settings.adaptiveFFTOrder = true; }
+        else if (arg == "--estimator" && hasValue)
+        {
+            const juce::String estimatorName (argv[++i]);
+            if (estimatorName == "mpm")          { settings.estimatorType = SimpleTunerAudioProcessor::EstimatorType::mcLeodPitchMethod; }
+            else if (estimatorName == "fft")     { settings.estimatorType = SimpleTunerAudioProcessor::EstimatorType::fftPhaseVocoder; }
+            else if (estimatorName == "pyramid") { settings.estimatorType = SimpleTunerAudioProcessor::EstimatorType::octavePyramid; }
+            else                                 { printUsage(); return 1; }
+        }
+        else if (arg == "--ref" && hasValue)     { settings.referenceFrequency = juce::String(argv[++i]).getFloatValue(); }
+        else if (arg == "--temperament" && hasValue)
+        {
+            const juce::String temperamentName (argv[++i]);
+            if (temperamentName == "equal")              { settings.temperament = NoteMapper::equal; }
+            else if (temperamentName == "pythagorean")   { settings.temperament = NoteMapper::pythagorean; }
+            else if (temperamentName == "meantone")      { settings.temperament = NoteMapper::quarterCommaMeantone; }
+            else if (temperamentName == "just")          { settings.temperament = NoteMapper::justIntonation; }
+            else if (temperamentName == "werckmeister3") { settings.temperament = NoteMapper::werckmeisterIII; }
+            else                                         { printUsage(); return 1; }
+        }
+        else if (arg == "--key" && hasValue)     { settings.temperamentKey = juce::jlimit(0, 11, juce::String(argv[++i]).getIntValue()); }
+        else if (arg == "--stretch" && hasValue) { settings.stretchCentsPerOctave = juce::String(argv[++i]).getFloatValue(); }
+        else if (arg == "--threads" && hasValue) { settings.numThreads = juce::jmax(1, juce::String(argv[++i]).getIntValue()); }
+        else if (arg == "--out" && hasValue)     { settings.outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]); }
+        else if (arg.startsWith("--"))           { printUsage(); return 1; }
+        else                                     { filesToAnalyze.add(juce::File::getCurrentWorkingDirectory().getChildFile(arg)); }
+    }
+
+    if (filesToAnalyze.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<FileAnalysisResult> results (static_cast<size_t>(filesToAnalyze.size()));
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    {
+        //One job per file. Files are independent so they scale across all cores.
+        juce::ThreadPool threadPool (settings.numThreads);
+
+        for (int i = 0; i < filesToAnalyze.size(); ++i)
+        {
+            threadPool.addJob(new FileAnalysisJob(filesToAnalyze[i], settings, results[static_cast<size_t>(i)]), true); //deleteJobWhenFinished
+        }
+
+        while (threadPool.getNumJobs() > 0)
+        {
+            juce::Thread::sleep(10);
+        }
+    }
+    const double wallSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime)/1000.0;
+
+    double totalAudioSeconds = 0;
+    int numFailed = 0;
+
+    for (const auto& result : results)
+    {
+        if (result.succeeded)
+        {
+            totalAudioSeconds += result.audioSeconds;
+            std::cout << result.fileName << ": " << result.numFrames << " frames, "
+                      << juce::String(result.audioSeconds, 2) << " s audio, "
+                      << juce::String(result.audioSeconds/juce::jmax(result.processingSeconds, 1.0e-9), 1) << "x realtime" << std::endl;
+        }
+        else
+        {
+            ++numFailed;
+            std::cerr << result.fileName << ": " << result.errorMessage << std::endl;
+        }
+    }
+
+    std::cout << "Total: " << juce::String(totalAudioSeconds, 2) << " s audio in " << juce::String(wallSeconds, 2) << " s on "
+              << settings.numThreads << " threads = " << juce::String(totalAudioSeconds/juce::jmax(wallSeconds, 1.0e-9), 1) << "x realtime" << std::endl;
+
+    return (numFailed == 0) ? 0 : 1;
+}
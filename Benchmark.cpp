@@ -0,0 +1,567 @@
+/*
+  ==============================================================================
+
+    Benchmark suite for the tuner DSP.
+    Macro: drives SimpleTunerAudioProcessor::processBlock with a synthetic signal
+           for every FFTOrder x sample rate x host block size.
+    Micro: times the AudioBufferFifo ingest, findComplexMaxIndex,
+           fundamentalFrequencyChecker and FFTDataGenerator::produceFFTData on their own
+           (and FixedOrderFFTDataGenerator::produceFFTData and ZoomTransform::findPeakBin next to it).
+    Instances: constructs and prepares a template's worth of processors (1 per channel strip)
+           and times the first one, which builds the shared FFT plans/windows, against the rest.
+    Estimator: every PitchEstimator backend on the same note onsets (low A, low E, high E). Latency is the time
+           from the onset to the first reading within 5 cents, CPU is for the whole processBlock.
+    Zoom: the FFT phase vocoder with and without setZoomCrossCheck, for every FFTOrder on held notes, clean and
+           with noise. The worst cent error and the mean confidence of the readings in the second half, against the cost
+           (the zoom's own frequency error is in the zoomTransform micro benchmark).
+
+    Results are printed as CSV on stdout so runs can be diffed/compared:
+        suite,name,fft_order,sample_rate,block_size,iterations,ns_per_call,ns_per_sample,ffts_per_second,cpu_percent,latency_ms,max_cents_error,mean_confidence
+    (fft_order is log2 of the estimator's window length for the estimator suite. The last 2 columns are the zoom suite's)
+
+    Usage: ChromaticTunerBenchmark [--seconds S] [--quick] [--macro-only] [--micro-only] [--background] [--tracking] [--adaptive] [--channels N] [--dynamic-fft] [--low-memory] [--no-decimation]
+        --background   run the processor with its background analysis thread, so the macro suite shows the audio thread's cost
+        --tracking     turn on the sliding DFT tracking mode, so the macro suite shows the steady-state cost of a held note
+        --adaptive     let the processor pick the FFT order from the detected pitch (the macro signal is a low E, so it ends up at the largest order)
+        --channels N   feed the macro suite N input channels (each is its own tuner), to see how the cost scales with a whole stage box
+        --dynamic-fft  use the runtime sized FFTDataGenerator instead of FixedOrderFFTDataGenerator, to compare the two
+        --low-memory   macro suite runs in low memory mode (setLowMemoryMode). The instances suite always reports both
+        --no-decimation  analyse 88.2k-192k at the host rate instead of decimating to 44.1/48k first (setDecimation(false)), to compare the two
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+struct BenchmarkSettings
+{
+    double secondsOfAudio = 2.0; //per macro configuration
+    int microIterations = 2000;
+    bool runMacro = true;
+    bool runMicro = true;
+    bool quick = false; //fewer configurations, for a fast sanity check
+    bool backgroundAnalysis = false; //macro suite measures only the audio thread's share, the FFTs run on the analysis thread
+    bool trackingMode = false; //macro suite mostly runs the sliding DFT instead of the FFT (the test signal is a held note)
+    bool adaptiveFFTOrder = false;
+    int numChannels = 1; //macro suite only
+    bool fixedOrderFFT = true; //macro suite. The micro suite always runs both
+    bool lowMemoryMode = false; //macro suite
+    bool decimation = true; //macro suite. Only makes a difference from 88.2 kHz up
+};
+
+struct BenchmarkResult
+{
+    juce::String suite, name;
+    int fftOrder = 0;
+    double sampleRate = 0;
+    int blockSize = 0;
+    juce::int64 iterations = 0;
+    double nsPerCall = 0;
+    double nsPerSample = 0; //only meaningful for the macro suite
+    double fftsPerSecond = 0;
+    double cpuPercent = 0; //ns/sample relative to the real time budget of 1/sampleRate
+    double latencyMs = 0; //estimator suite only
+    double maxCentsError = 0; //zoom suite only
+    double meanConfidence = 0; //the same
+};
+
+//Stops the compiler from optimizing away results we don't otherwise use
+static volatile float benchmarkSink = 0;
+
+static double ticksToNanoseconds(juce::int64 ticks)
+{
+    return juce::Time::highResolutionTicksToSeconds(ticks)*1.0e9;
+}
+
+//A low E string-ish test signal: fundamental + a couple of harmonics + a bit of noise, so the harmonic checker has work to do
+static void fillSyntheticSignal(std::vector<float>& signal, double sampleRate, double frequency)
+{
+    juce::Random random (1234);
+    for (size_t n = 0; n < signal.size(); ++n)
+    {
+        const double phase = juce::MathConstants<double>::twoPi*frequency*static_cast<double>(n)/sampleRate;
+        signal[n] = static_cast<float>( 0.30*std::sin(phase) + 0.45*std::sin(3*phase) + 0.15*std::sin(5*phase) )
+                    + 0.001f*(random.nextFloat()-0.5f);
+    }
+}
+
+static void printHeader()
+{
+    std::cout << "suite,name,fft_order,sample_rate,block_size,iterations,ns_per_call,ns_per_sample,ffts_per_second,cpu_percent,latency_ms,max_cents_error,mean_confidence" << std::endl;
+}
+
+static void printResult(const BenchmarkResult& r)
+{
+    std::cout << r.suite << "," << r.name << "," << r.fftOrder << "," << juce::String(r.sampleRate, 0) << "," << r.blockSize << ","
+              << r.iterations << "," << juce::String(r.nsPerCall, 1) << "," << juce::String(r.nsPerSample, 3) << ","
+              << juce::String(r.fftsPerSecond, 1) << "," << juce::String(r.cpuPercent, 4) << "," << juce::String(r.latencyMs, 2) << ","
+              << juce::String(r.maxCentsError, 4) << "," << juce::String(r.meanConfidence, 3) << std::endl;
+}
+
+//==============================================================================
+static BenchmarkResult runProcessBlockBenchmark(int fftOrder, double sampleRate, int blockSize, const BenchmarkSettings& settings)
+{
+    SimpleTunerAudioProcessor processor (fftOrder);
+    processor.setBackgroundAnalysis(settings.backgroundAnalysis);
+    processor.setTrackingMode(settings.trackingMode);
+    processor.setAdaptiveFFTOrder(settings.adaptiveFFTOrder);
+    processor.setFixedOrderFFT(settings.fixedOrderFFT);
+    processor.setLowMemoryMode(settings.lowMemoryMode);
+    processor.setDecimation(settings.decimation);
+    processor.setPlayConfigDetails(settings.numChannels, settings.numChannels, sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    const int numBlocks = juce::jmax(4, static_cast<int>(settings.secondsOfAudio*sampleRate/blockSize));
+    const int hopSize = processor.getAnalysisHopSize();
+    const int windowHostSamples = (1 << fftOrder)*processor.getDecimationFactor(); //the window is in decimated samples
+    const int numWarmupBlocks = juce::jmax(2, ((windowHostSamples + 2*hopSize)/blockSize) + 2); //fill the FFT window and get the first reading before timing
+
+    std::vector<float> signal (static_cast<size_t>((numBlocks+numWarmupBlocks)*blockSize));
+    fillSyntheticSignal(signal, sampleRate, 82.41);
+
+    juce::AudioBuffer<float> block (settings.numChannels, blockSize);
+    juce::MidiBuffer midi;
+    size_t readPosition = 0;
+
+    auto processNextBlock = [&]()
+    {
+        for (int channel = 0; channel < settings.numChannels; ++channel)
+        {
+            juce::FloatVectorOperations::copy(block.getWritePointer(channel), signal.data()+readPosition, blockSize);
+        }
+        readPosition += static_cast<size_t>(blockSize);
+        processor.processBlock(block, midi);
+    };
+
+    for (int i = 0; i < numWarmupBlocks; ++i)
+    {
+        processNextBlock();
+    }
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        processNextBlock();
+    }
+    const double elapsedNs = ticksToNanoseconds(juce::Time::getHighResolutionTicks()-startTicks);
+
+    processor.releaseResources();
+    benchmarkSink = benchmarkSink + processor.getCurrentExactF();
+
+    BenchmarkResult r;
+    r.suite = "macro";
+    r.name = juce::String(settings.backgroundAnalysis ? "processBlockBackgroundAnalysis" : "processBlock") + (settings.trackingMode ? "Tracking" : "") + (settings.adaptiveFFTOrder ? "Adaptive" : "") + (settings.fixedOrderFFT ? "" : "DynamicFFT") + (settings.lowMemoryMode ? "LowMemory" : "") + (settings.decimation ? "" : "NoDecimation")
+             + (settings.numChannels > 1 ? juce::String("x") + juce::String(settings.numChannels) + "Channels" : juce::String());
+    r.fftOrder = fftOrder;
+    r.sampleRate = sampleRate;
+    r.blockSize = blockSize;
+    r.iterations = numBlocks;
+    r.nsPerCall = elapsedNs/numBlocks;
+    r.nsPerSample = elapsedNs/(static_cast<double>(numBlocks)*blockSize);
+    r.fftsPerSecond = (settings.backgroundAnalysis || settings.trackingMode) ? 0 : (static_cast<double>(numBlocks)*blockSize/hopSize)*settings.numChannels/(elapsedNs*1.0e-9); //one FFT per hop per channel, unless they're on another thread or skipped by the tracker
+    r.cpuPercent = 100.0*r.nsPerSample*sampleRate*1.0e-9;
+    return r;
+}
+
+//==============================================================================
+//Silence, then a note: how long until the backend reads it right, and what it costs per sample on the same input
+static BenchmarkResult runEstimatorBenchmark(SimpleTunerAudioProcessor::EstimatorType estimatorType, double sampleRate, double frequency,
+                                             const BenchmarkSettings& settings)
+{
+    constexpr int blockSize = 128;
+    constexpr double toleranceCents = 5.0;
+    
+    SimpleTunerAudioProcessor processor;
+    processor.setEstimatorType(estimatorType);
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+    
+    const int onsetBlock = static_cast<int>(0.25*sampleRate/blockSize);
+    const int numBlocks = onsetBlock + juce::jmax(4, static_cast<int>(settings.secondsOfAudio*sampleRate/blockSize));
+    
+    std::vector<float> signal (static_cast<size_t>((numBlocks-onsetBlock)*blockSize));
+    fillSyntheticSignal(signal, sampleRate, frequency);
+    
+    juce::AudioBuffer<float> block (1, blockSize);
+    juce::MidiBuffer midi;
+    double elapsedNs = 0;
+    int firstGoodBlock = -1;
+    
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        if (i < onsetBlock)
+        {
+            block.clear();
+        }
+        else
+        {
+            juce::FloatVectorOperations::copy(block.getWritePointer(0), signal.data()+static_cast<size_t>((i-onsetBlock)*blockSize), blockSize);
+        }
+        
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        processor.processBlock(block, midi);
+        elapsedNs += ticksToNanoseconds(juce::Time::getHighResolutionTicks()-startTicks);
+        
+        const float exactF = processor.getCurrentExactF();
+        if (firstGoodBlock < 0 && i >= onsetBlock && exactF > 0.f && std::abs(1200.0*std::log2(exactF/frequency)) < toleranceCents)
+        {
+            firstGoodBlock = i;
+        }
+    }
+    
+    BenchmarkResult r;
+    r.suite = "estimator";
+    r.name = processor.getEstimatorName() + " " + juce::String(frequency, 2) + "Hz";
+    r.fftOrder = juce::roundToInt(std::log2(processor.getCurrentWindowLength()));
+    r.sampleRate = sampleRate;
+    r.blockSize = blockSize;
+    r.iterations = numBlocks;
+    r.nsPerCall = elapsedNs/numBlocks;
+    r.nsPerSample = elapsedNs/(static_cast<double>(numBlocks)*blockSize);
+    r.cpuPercent = 100.0*r.nsPerSample*sampleRate*1.0e-9;
+    r.latencyMs = (firstGoodBlock < 0) ? -1.0 : 1000.0*(firstGoodBlock-onsetBlock+1)*blockSize/sampleRate; //-1: never read it right
+    return r;
+}
+
+//==============================================================================
+//A held note through the phase vocoder, zoom cross-check on or off: how far the readings stray and how sure they are, for what it costs
+static BenchmarkResult runZoomBenchmark(int fftOrder, bool zoomCrossCheck, double sampleRate, double frequency, float noiseAmplitude,
+                                        const BenchmarkSettings& settings)
+{
+    constexpr int blockSize = 128;
+    
+    SimpleTunerAudioProcessor processor (fftOrder);
+    processor.setZoomCrossCheck(zoomCrossCheck);
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+    
+    const int numBlocks = juce::jmax(8, static_cast<int>(juce::jmax(1.0, settings.secondsOfAudio)*sampleRate/blockSize));
+    std::vector<float> signal (static_cast<size_t>(numBlocks*blockSize));
+    fillSyntheticSignal(signal, sampleRate, frequency);
+    juce::Random random (5678);
+    for (auto& sample : signal)
+    {
+        sample += noiseAmplitude*(random.nextFloat()-0.5f);
+    }
+    
+    juce::AudioBuffer<float> block (1, blockSize);
+    juce::MidiBuffer midi;
+    double elapsedNs = 0, maxCentsError = 0, totalConfidence = 0;
+    int numMeasuredBlocks = 0;
+    
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        juce::FloatVectorOperations::copy(block.getWritePointer(0), signal.data()+static_cast<size_t>(i*blockSize), blockSize);
+        
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        processor.processBlock(block, midi);
+        elapsedNs += ticksToNanoseconds(juce::Time::getHighResolutionTicks()-startTicks);
+        
+        if (i >= numBlocks/2) //well after the window has filled
+        {
+            const auto reading = processor.getCurrentReading();
+            const double centsError = (reading.frequency > 0.f) ? std::abs(1200.0*std::log2(reading.frequency/frequency)) : 1200.0;
+            maxCentsError = juce::jmax(maxCentsError, centsError);
+            totalConfidence += reading.confidence;
+            ++numMeasuredBlocks;
+        }
+    }
+    
+    BenchmarkResult r;
+    r.suite = "zoom";
+    r.name = juce::String(zoomCrossCheck ? "zoomCrossCheck " : "phaseDifference ") + juce::String(frequency, 2) + "Hz" + (noiseAmplitude > 0.f ? "Noisy" : "");
+    r.fftOrder = fftOrder;
+    r.sampleRate = sampleRate;
+    r.blockSize = blockSize;
+    r.iterations = numBlocks;
+    r.nsPerCall = elapsedNs/numBlocks;
+    r.nsPerSample = elapsedNs/(static_cast<double>(numBlocks)*blockSize);
+    r.cpuPercent = 100.0*r.nsPerSample*sampleRate*1.0e-9;
+    r.maxCentsError = maxCentsError;
+    r.meanConfidence = totalConfidence/numMeasuredBlocks;
+    return r;
+}
+
+//==============================================================================
+template<typename Function>
+static BenchmarkResult timeMicroKernel(const juce::String& name, int fftOrder, double sampleRate, int iterations, Function&& kernel)
+{
+    for (int i = 0; i < iterations/10 + 1; ++i)
+    {
+        kernel(); //warm up the caches
+    }
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    for (int i = 0; i < iterations; ++i)
+    {
+        kernel();
+    }
+    const double elapsedNs = ticksToNanoseconds(juce::Time::getHighResolutionTicks()-startTicks);
+
+    BenchmarkResult r;
+    r.suite = "micro";
+    r.name = name;
+    r.fftOrder = fftOrder;
+    r.sampleRate = sampleRate;
+    r.blockSize = 1 << fftOrder;
+    r.iterations = iterations;
+    r.nsPerCall = elapsedNs/iterations;
+    r.nsPerSample = r.nsPerCall/r.blockSize;
+    r.fftsPerSecond = iterations/(elapsedNs*1.0e-9);
+    return r;
+}
+
+static void runMicroBenchmarks(int fftOrder, const BenchmarkSettings& settings)
+{
+    const double sampleRate = 48000;
+    const int fftSize = 1 << fftOrder;
+
+    SimpleTunerAudioProcessor processor (fftOrder);
+    processor.setRateAndBufferSizeDetails(sampleRate, 512);
+    processor.prepareToPlay(sampleRate, 512);
+
+    std::vector<float> signal (static_cast<size_t>(fftSize));
+    fillSyntheticSignal(signal, sampleRate, 82.41);
+
+    juce::AudioBuffer<float> audioBuffer (1, fftSize);
+    juce::FloatVectorOperations::copy(audioBuffer.getWritePointer(0), signal.data(), fftSize);
+
+    FFTDataGenerator< std::vector<float> > generator (fftOrder);
+    std::vector<float> fftFrame (static_cast<size_t>(fftSize*2), 0);
+
+    //produceFFTData: window + FFT into a pool frame. We hand the frame straight back so the pool never fills up.
+    printResult(timeMicroKernel("produceFFTData", fftOrder, sampleRate, settings.microIterations, [&]()
+    {
+        generator.produceFFTData(audioBuffer);
+        generator.finishedWithTopFrame();
+    }));
+    
+    //The same through the compile time specialisation, if this order has one
+    if (auto fixedOrderGenerator = makeFixedOrderFFTDataGenerator(fftOrder))
+    {
+        printResult(timeMicroKernel("produceFFTDataFixedOrder", fftOrder, sampleRate, settings.microIterations, [&]()
+        {
+            fixedOrderGenerator->produceFFTData(audioBuffer, 0);
+            fixedOrderGenerator->finishedWithTopFrame();
+        }));
+    }
+    
+    //The zoom transform around the low E's peak, next to the FFT it refines. Its frequency error is in max_cents_error
+    const auto zoomWindow = SharedFFTResources::getWindow(fftSize, SharedFFTResources::WindowType::blackmanHarris);
+    const double coarseBin = std::round(82.41*fftSize/sampleRate);
+    double zoomedBin = 0;
+    auto zoomResult = timeMicroKernel("zoomTransform", fftOrder, sampleRate, settings.microIterations, [&]()
+    {
+        zoomedBin = ZoomTransform::findPeakBin(signal.data(), fftSize, 0, zoomWindow->data(), fftSize, coarseBin);
+        benchmarkSink = benchmarkSink + static_cast<float>(zoomedBin);
+    });
+    zoomResult.maxCentsError = std::abs(1200.0*std::log2(zoomedBin*sampleRate/fftSize/82.41));
+    printResult(zoomResult);
+    
+    generator.produceFFTData(audioBuffer);
+    generator.getFFTData(fftFrame);
+
+    //fftFrame now holds a real spectrum of the test signal
+    printResult(timeMicroKernel("findComplexMaxIndex", fftOrder, sampleRate, settings.microIterations, [&]()
+    {
+        benchmarkSink = benchmarkSink + processor.findComplexMaxIndex(fftFrame.data());
+    }));
+    
+    //The original hypot-per-bin version, to see the speedup of the SIMD kernel per frame
+    printResult(timeMicroKernel("findComplexMaxIndexReference", fftOrder, sampleRate, settings.microIterations, [&]()
+    {
+        benchmarkSink = benchmarkSink + processor.findComplexMaxIndexReference(fftFrame.data());
+    }));
+    
+    if (processor.findComplexMaxIndex(fftFrame.data()) != processor.findComplexMaxIndexReference(fftFrame.data()))
+    {
+        std::cerr << "findComplexMaxIndex does not match the reference for order " << fftOrder << std::endl;
+    }
+
+    //Check the strongest (3rd harmonic) bin, the way findComplexMaxIndex does when it finds a new max
+    const int peakIndex = processor.findComplexMaxIndex(fftFrame.data());
+    const int thirdHarmonicIndex = 2*juce::roundToInt(3*82.41*fftSize/sampleRate);
+    const float thirdHarmonicMag = std::hypot(fftFrame[static_cast<size_t>(thirdHarmonicIndex)], fftFrame[static_cast<size_t>(thirdHarmonicIndex+1)]);
+    juce::ignoreUnused(peakIndex);
+
+    printResult(timeMicroKernel("fundamentalFrequencyChecker", fftOrder, sampleRate, settings.microIterations*100, [&]()
+    {
+        benchmarkSink = benchmarkSink + processor.fundamentalFrequencyChecker(thirdHarmonicIndex, thirdHarmonicMag, fftFrame.data());
+    }));
+}
+
+//Ingest only: host block -> AudioBufferFifo -> pulled back out as analysis hops. Small blocks are where this hurts most.
+static void runIngestBenchmarks(const BenchmarkSettings& settings)
+{
+    const double sampleRate = 48000;
+
+    for (int blockSize : { 16, 32, 64, 128, 256, 512 })
+    {
+        AudioBufferFifo< juce::AudioBuffer<float> > bufferFifo;
+        bufferFifo.prepare(1, blockSize, blockSize); //mono, hop == block, so every update gives exactly one hop back
+
+        std::vector<float> signal (static_cast<size_t>(blockSize));
+        fillSyntheticSignal(signal, sampleRate, 82.41);
+
+        juce::AudioBuffer<float> block (1, blockSize), pulledBlock (1, blockSize);
+        juce::FloatVectorOperations::copy(block.getWritePointer(0), signal.data(), blockSize);
+
+        auto r = timeMicroKernel("AudioBufferFifo::update", 0, sampleRate, settings.microIterations*50, [&]()
+        {
+            bufferFifo.update(block);
+            while (bufferFifo.getNumCompleteBuffersAvailable() > 0)
+            {
+                bufferFifo.getAudioBuffer(pulledBlock);
+            }
+            benchmarkSink = benchmarkSink + pulledBlock.getSample(0, 0);
+        });
+        r.blockSize = blockSize;
+        r.nsPerSample = r.nsPerCall/blockSize;
+        r.fftsPerSecond = 0;
+        r.cpuPercent = 100.0*r.nsPerSample*sampleRate*1.0e-9;
+        printResult(r);
+    }
+}
+
+//A session template with a tuner on every channel strip. The first instance builds the FFT plans and window tables,
+//the others only take references to them (SharedFFTResources.h)
+static void runInstantiationBenchmarks(const BenchmarkSettings& settings)
+{
+    const double sampleRate = 48000;
+    const int blockSize = 512;
+    const int numInstances = settings.quick ? 10 : 100;
+    
+    std::vector< std::unique_ptr<SimpleTunerAudioProcessor> > instances;
+    auto startTicks = juce::Time::getHighResolutionTicks();
+    juce::int64 firstInstanceTicks = 0;
+    
+    for (int i = 0; i < numInstances; ++i)
+    {
+        instances.push_back(std::make_unique<SimpleTunerAudioProcessor>());
+        instances.back()->setRateAndBufferSizeDetails(sampleRate, blockSize);
+        instances.back()->prepareToPlay(sampleRate, blockSize);
+        
+        if (i == 0)
+        {
+            firstInstanceTicks = juce::Time::getHighResolutionTicks() - startTicks;
+            startTicks = juce::Time::getHighResolutionTicks();
+        }
+    }
+    const juce::int64 otherInstancesTicks = juce::Time::getHighResolutionTicks() - startTicks;
+    
+    auto makeResult = [&](const juce::String& name, juce::int64 iterations, juce::int64 ticks)
+    {
+        BenchmarkResult r;
+        r.suite = "instances";
+        r.name = name;
+        r.fftOrder = SimpleTunerAudioProcessor::FFTOrder::order8192;
+        r.sampleRate = sampleRate;
+        r.blockSize = blockSize;
+        r.iterations = iterations;
+        r.nsPerCall = ticksToNanoseconds(ticks)/iterations;
+        return r;
+    };
+    printResult(makeResult("constructAndPrepareFirstInstance", 1, firstInstanceTicks));
+    printResult(makeResult("constructAndPrepareInstance", numInstances-1, otherInstancesTicks));
+    
+    //What's shared. Without the cache it would be numInstances times this
+    const auto stats = SharedFFTResources::getStats();
+    std::cerr << numInstances << " instances share " << stats.numFFTPlans << " FFT plans and " << stats.numWindowTables
+              << " window tables (" << stats.windowTableBytes/1024 << " KB). Built: " << stats.numFFTPlansBuilt << " plans, "
+              << stats.numWindowTablesBuilt << " tables" << std::endl;
+    
+    //What 1 instance holds on its own, normal and in low memory mode (the shared plans/tables aren't counted)
+    for (bool lowMemory : { false, true })
+    {
+        SimpleTunerAudioProcessor processor;
+        processor.setLowMemoryMode(lowMemory);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+        
+        const auto footprint = processor.getMemoryFootprint();
+        std::cerr << (lowMemory ? "Low memory" : "Normal") << " instance: " << footprint.getTotal()/1024 << " KB (objects "
+                  << footprint.processorObjects/1024 << " KB, sample ring " << footprint.sampleFifo/1024 << " KB, estimators "
+                  << footprint.estimators/1024 << " KB, scratch " << footprint.scratch/1024 << " KB)" << std::endl;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg (argv[i]);
+
+        if (arg == "--seconds" && i+1 < argc) { settings.secondsOfAudio = juce::jmax(0.1, juce::String(argv[++i]).getDoubleValue()); }
+        else if (arg == "--quick")            { settings.quick = true; settings.secondsOfAudio = 0.5; settings.microIterations = 200; }
+        else if (arg == "--macro-only")       { settings.runMicro = false; }
+        else if (arg == "--micro-only")       { settings.runMacro = false; }
+        else if (arg == "--background")       { settings.backgroundAnalysis = true; }
+        else if (arg == "--tracking")         { settings.trackingMode = true; }
+        else if (arg == "--adaptive")         { settings.adaptiveFFTOrder = true; }
+        else if (arg == "--dynamic-fft")      { settings.fixedOrderFFT = false; }
+        else if (arg == "--low-memory")       { settings.lowMemoryMode = true; }
+        else if (arg == "--no-decimation")    { settings.decimation = false; }
+        else if (arg == "--channels" && i+1 < argc) { settings.numChannels = juce::jlimit(1, SimpleTunerAudioProcessor::maxAnalysisChannels, juce::String(argv[++i]).getIntValue()); }
+        else
+        {
+            std::cerr << "Usage: ChromaticTunerBenchmark [--seconds S] [--quick] [--macro-only] [--micro-only] [--background] [--tracking] [--adaptive] [--channels N] [--dynamic-fft] [--low-memory] [--no-decimation]" << std::endl;
+            return 1;
+        }
+    }
+
+    const std::vector<int> fftOrders { SimpleTunerAudioProcessor::FFTOrder::order2048,
+                                       SimpleTunerAudioProcessor::FFTOrder::order4096,
+                                       SimpleTunerAudioProcessor::FFTOrder::order8192 };
+
+    const std::vector<double> sampleRates = settings.quick ? std::vector<double> { 48000 }
+                                                           : std::vector<double> { 44100, 48000, 88200, 96000, 176400, 192000 };
+
+    const std::vector<int> blockSizes = settings.quick ? std::vector<int> { 32, 512 }
+                                                       : std::vector<int> { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+
+    printHeader();
+
+    if (settings.runMicro)
+    {
+        runIngestBenchmarks(settings);
+        runInstantiationBenchmarks(settings);
+
+        for (int fftOrder : fftOrders)
+        {
+            runMicroBenchmarks(fftOrder, settings);
+        }
+    }
+
+    if (settings.runMacro)
+    {
+        for (auto estimatorType : { SimpleTunerAudioProcessor::EstimatorType::fftPhaseVocoder,
+                                    SimpleTunerAudioProcessor::EstimatorType::mcLeodPitchMethod,
+                                    SimpleTunerAudioProcessor::EstimatorType::octavePyramid })
+            for (double sampleRate : sampleRates)
+                for (double frequency : { 27.5, 82.41, 329.63 }) //low A of a piano, low and high E
+                {
+                    printResult(runEstimatorBenchmark(estimatorType, sampleRate, frequency, settings));
+                }
+        
+        for (int fftOrder : fftOrders)
+            for (double frequency : { 82.41, 196.0, 440.0 }) //low E, G and A strings
+                for (float noiseAmplitude : { 0.f, 0.5f })
+                    for (bool zoomCrossCheck : { false, true })
+                    {
+                        printResult(runZoomBenchmark(fftOrder, zoomCrossCheck, 48000, frequency, noiseAmplitude, settings));
+                    }
+        
+        for (int fftOrder : fftOrders)
+            for (double sampleRate : sampleRates)
+                for (int blockSize : blockSizes)
+                {
+                    printResult(runProcessBlockBenchmark(fftOrder, sampleRate, blockSize, settings));
+                }
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+  ==============================================================================
+
+    FFTFrameGenerator.h
+    What the analysis needs from an FFT frame producer (FFTFrameGenerator),
+    and a version of FFTDataGenerator that's specialised on the FFT order at
+    compile time (FixedOrderFFTDataGenerator).
+
+    The fixed version keeps its frames in std::arrays, so every loop bound is
+    a constant. The Blackman-Harris window and the FFT plan come from
+    SharedFFTResources, built once at runtime and shared by every instance
+    (a constexpr table of 4096/8192 cosines is past the step limits of Clang
+    and MSVC).
+    The order is still picked at runtime (masterFFTOrder, adaptive mode):
+    makeFixedOrderFFTDataGenerator switches on it and returns the matching
+    specialisation, or nullptr for an order that doesn't have one.
+    After that it's 1 virtual call per FFT, not per sample.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <memory>
+#include "SharedFFTResources.h"
+
+class FFTFrameGenerator
+{
+public:
+    virtual ~FFTFrameGenerator() = default;
+
+    //Windowed FFT of the newest getFFTSize() samples of a circular history (see FFTDataGenerator::produceFFTData).
+    //Returns false if the frame pool is full
+    virtual bool produceFFTData(const juce::AudioBuffer<float>& circularAudioData, int oldestSampleIndex, juce::int64 frameEndSample = 0) = 0;
+
+    //The 2 oldest frames, in place. Returns how many there were (0, 1 or 2)
+    virtual int viewTopAndNext(const float*& topFrame, const float*& nextFrame, juce::int64* nextFrameEndSample = nullptr) const = 0;
+    virtual void finishedWithTopFrame() = 0;
+
+    virtual int getFFTSize() const = 0;
+    virtual int getNumAvailableFFTDataBlocks() const = 0;
+    virtual void reset() = 0; //not thread safe, only when nobody is reading/writing
+    virtual size_t getMemoryBytes() const = 0; //the frame pool and everything else this generator owns
+};
+
+template<int Order>
+class FixedOrderFFTDataGenerator : public FFTFrameGenerator
+{
+public:
+    static constexpr int fftSize = 1 << Order;
+    static constexpr float inverseFFTSize = 1.f/fftSize; //bin k is k*sampleRate*inverseFFTSize Hz
+
+    FixedOrderFFTDataGenerator()
+        : fftObject(SharedFFTResources::getFFT(Order)),
+          windowTable(SharedFFTResources::getWindow(fftSize, SharedFFTResources::WindowType::blackmanHarris)),
+          window(windowTable->data())
+    {
+        jassert(static_cast<int>(windowTable->size()) == fftSize);
+    }
+
+    bool produceFFTData(const juce::AudioBuffer<float>& circularAudioData, int oldestSampleIndex, juce::int64 frameEndSample = 0) override
+    {
+        //Same as FFTDataGenerator::produceFFTData, with fftSize a constant
+        const int historySize = circularAudioData.getNumSamples();
+        jassert(historySize >= fftSize);
+        jassert(oldestSampleIndex >= 0 && oldestSampleIndex < historySize);
+
+        int startIndex1, blockSize1, startIndex2, blockSize2;
+        frameIndexFifo.prepareToWrite(1, startIndex1, blockSize1, startIndex2, blockSize2);
+        if (blockSize1 == 0)
+        {
+            return false;
+        }
+
+        float* fftData = framePool[static_cast<size_t>(startIndex1)].data();
+        auto* readIndex = circularAudioData.getReadPointer(0);
+        const int windowStartIndex = (oldestSampleIndex + historySize - fftSize) % historySize;
+        const int numSamplesInFirstSegment = juce::jmin(fftSize, historySize-windowStartIndex);
+
+        if (numSamplesInFirstSegment == fftSize)
+        {
+            applyWindow(fftData, readIndex+windowStartIndex); //no wrap, the common case when the history is longer than the window
+        }
+        else
+        {
+            juce::FloatVectorOperations::multiply(fftData, readIndex+windowStartIndex, window, numSamplesInFirstSegment);
+            juce::FloatVectorOperations::multiply(fftData+numSamplesInFirstSegment, readIndex, window+numSamplesInFirstSegment, fftSize-numSamplesInFirstSegment);
+        }
+
+        fftObject->performRealOnlyForwardTransform(fftData);
+
+        frameEndSamples[static_cast<size_t>(startIndex1)] = frameEndSample;
+        frameIndexFifo.finishedWrite(1);
+        return true;
+    }
+
+    int viewTopAndNext(const float*& topFrame, const float*& nextFrame, juce::int64* nextFrameEndSample = nullptr) const override
+    {
+        int startIndex1, blockSize1, startIndex2, blockSize2;
+        frameIndexFifo.prepareToRead(2, startIndex1, blockSize1, startIndex2, blockSize2);
+
+        if (blockSize1 == 0)
+        {
+            return 0;
+        }
+
+        topFrame = framePool[static_cast<size_t>(startIndex1)].data();
+
+        if (blockSize1 == 1 && blockSize2 == 0)
+        {
+            return 1;
+        }
+
+        const int nextIndex = (blockSize1 > 1) ? startIndex1+1 : startIndex2;
+        nextFrame = framePool[static_cast<size_t>(nextIndex)].data();
+        if (nextFrameEndSample != nullptr)
+        {
+            *nextFrameEndSample = frameEndSamples[static_cast<size_t>(nextIndex)];
+        }
+        return 2;
+    }
+
+    void finishedWithTopFrame() override { frameIndexFifo.finishedRead(1); }
+    int getFFTSize() const override { return fftSize; }
+    int getNumAvailableFFTDataBlocks() const override { return frameIndexFifo.getNumReady(); }
+    void reset() override { frameIndexFifo.reset(); }
+    size_t getMemoryBytes() const override { return sizeof(*this); } //the frames are inside the object
+
+private:
+    //A constant trip count, so the compiler can unroll and vectorise it without a remainder loop
+    void applyWindow(float* dest, const float* src) const
+    {
+        for (int i = 0; i < fftSize; ++i)
+        {
+            dest[i] = src[i]*window[i];
+        }
+    }
+
+    static constexpr int FrameCapacity = 30; //the same as FFTDataGenerator
+    std::array<std::array<float, fftSize*2>, FrameCapacity> framePool {}; //about 2MB for order8192, so always make these on the heap
+    std::array<juce::int64, FrameCapacity> frameEndSamples {};
+    juce::AbstractFifo frameIndexFifo {FrameCapacity};
+    std::shared_ptr<const juce::dsp::FFT> fftObject;
+    std::shared_ptr<const std::vector<float>> windowTable; //normalised, the same table FFTDataGenerator uses
+    const float* window; //windowTable->data(), fftSize long
+};
+
+//The runtime order -> compile time order dispatch. nullptr if there's no specialisation for this order
+inline std::unique_ptr<FFTFrameGenerator> makeFixedOrderFFTDataGenerator(int order)
+{
+    switch (order)
+    {
+        case 11: return std::make_unique< FixedOrderFFTDataGenerator<11> >();
+        case 12: return std::make_unique< FixedOrderFFTDataGenerator<12> >();
+        case 13: return std::make_unique< FixedOrderFFTDataGenerator<13> >();
+        default: return nullptr;
+    }
+}
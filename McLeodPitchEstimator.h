@@ -0,0 +1,262 @@
+/*
+  ==============================================================================
+
+    McLeodPitchEstimator.h
+    Time domain pitch detection with the McLeod Pitch Method (MPM).
+    It looks for the period in the normalised square difference function (NSDF)
+    instead of looking for a peak in the spectrum, so it only needs ~2 periods
+    of the lowest note in the window (2048 samples at 48 kHz down to 47 Hz,
+    where the FFT method uses 8192).
+
+    The autocorrelation part of the NSDF is done with an FFT of twice the window
+    length (zero padded so it doesn't wrap around): r = IFFT(|FFT(x)|^2).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "PitchEstimator.h"
+#include "SharedFFTResources.h"
+
+class McLeodPitchEstimator : public PitchEstimator
+{
+public:
+    juce::String getName() const override { return "McLeod pitch method"; }
+
+    void prepare(double sampleRateToUse, int hopSizeToUse) override
+    {
+        sampleRate = sampleRateToUse;
+        hopSize = hopSizeToUse;
+        windowLength = juce::nextPowerOfTwo(static_cast<int>(std::ceil(periodsInWindow*sampleRate/minFrequency)));
+
+        const int fftSize = 2*windowLength; //zero padded, so the autocorrelation is linear instead of circular
+        fftObject = SharedFFTResources::getFFT(juce::roundToInt(std::log2(fftSize)));
+
+        history.assign(static_cast<size_t>(windowLength), 0.f);
+        historyWritePosition = 0;
+        numSamplesSeen = 0;
+
+        fftBuffer.assign(static_cast<size_t>(fftSize*2), 0.f); //the real only FFT needs 2*size
+        nsdf.assign(static_cast<size_t>(windowLength/2), 0.f);
+    }
+
+    bool processHop(const float* hopSamples, int numSamples, juce::int64 endSample, PitchReading& reading) override
+    {
+        writeToHistory(hopSamples, numSamples);
+
+        if (numSamplesSeen < windowLength)
+        {
+            return false; //the window isn't full yet
+        }
+
+        reading.sampleTime = endSample;
+
+        //Oldest sample first, then zeros for the padding
+        float* data = fftBuffer.data();
+        const int numUntilEnd = windowLength-historyWritePosition;
+        juce::FloatVectorOperations::copy(data, history.data()+historyWritePosition, numUntilEnd);
+        juce::FloatVectorOperations::copy(data+numUntilEnd, history.data(), historyWritePosition);
+        juce::FloatVectorOperations::clear(data+windowLength, static_cast<int>(fftBuffer.size())-windowLength);
+
+        //m(tau) below needs the energy of the window anyway, and it tells us if there's anything to analyse
+        double energy = 0;
+        for (int n = 0; n < windowLength; ++n)
+        {
+            energy += static_cast<double>(data[n])*data[n];
+        }
+
+        const float amplitude = static_cast<float>(std::sqrt(2.0*energy/windowLength)); //of a sine with the same energy
+        reading.magnitude = amplitude*windowLength/2;
+        if (amplitude < silenceAmplitude)
+        {
+            reading.frequency = 0.f;
+            return true;
+        }
+
+        computeNSDF(energy);
+        reading.frequency = findFrequencyInNSDF(reading.confidence);
+        return true;
+    }
+
+    void skipHop(const float* hopSamples, int numSamples) override
+    {
+        writeToHistory(hopSamples, numSamples); //no FFT. The NSDF only needs the window, so the next hop reads normally
+    }
+    
+    void handleDiscontinuity() override
+    {
+        //The gap can be anywhere in the next hop, so count that whole hop as old
+        numSamplesSeen = -hopSize;
+    }
+    
+    int getWindowLength() const override { return windowLength; }
+    
+    size_t getMemoryBytes() const override
+    {
+        return (history.capacity() + fftBuffer.capacity() + nsdf.capacity())*sizeof(float);
+    }
+
+private:
+    static constexpr double minFrequency = 47.0; //a bit under the low B of a 5 string bass (30.9 Hz needs 8192 at 48k, so it's left out)
+    static constexpr double maxFrequency = 4200.0; //the top note of a piano
+    static constexpr double periodsInWindow = 2.0; //MPM needs 2 periods of the lowest note
+    static constexpr float keyMaximumCutoff = 0.93f; //the first key maximum this close to the highest one is the period (McLeod uses 0.8-1.0)
+    static constexpr float minClarity = 0.6f; //below this the NSDF peak isn't periodic enough to call it a note
+    static constexpr float silenceAmplitude = 0.002f; //same as the FFT path's threshold (0.001*fftLength on a bin)
+
+    void writeToHistory(const float* samples, int numSamples)
+    {
+        //Only the newest windowLength samples matter
+        if (numSamples >= windowLength)
+        {
+            samples += numSamples-windowLength;
+            numSamples = windowLength;
+        }
+
+        const int numUntilEnd = juce::jmin(numSamples, windowLength-historyWritePosition);
+        juce::FloatVectorOperations::copy(history.data()+historyWritePosition, samples, numUntilEnd);
+        juce::FloatVectorOperations::copy(history.data(), samples+numUntilEnd, numSamples-numUntilEnd);
+
+        historyWritePosition = (historyWritePosition+numSamples) % windowLength;
+        numSamplesSeen = juce::jmin(numSamplesSeen+numSamples, windowLength); //(negative after a discontinuity)
+    }
+
+    void computeNSDF(double energy)
+    {
+        //fftBuffer holds the window (oldest first) and its padding. Its autocorrelation comes out in fftBuffer[0..windowLength)
+        const int fftSize = 2*windowLength;
+        float* data = fftBuffer.data();
+
+        fftObject->performRealOnlyForwardTransform(data);
+        for (int bin = 0; bin <= fftSize/2; ++bin)
+        {
+            data[2*bin] = data[2*bin]*data[2*bin] + data[2*bin+1]*data[2*bin+1]; //|X|^2
+            data[2*bin+1] = 0.f;
+        }
+        fftObject->performRealOnlyInverseTransform(data);
+
+        //r(0) is the energy. Scaling by that makes us independent of how the FFT scales its inverse
+        const double autocorrelationScale = energy/juce::jmax(1.0e-30, static_cast<double>(data[0]));
+
+        //nsdf(tau) = 2*r(tau)/m(tau), m(tau) = sum of x(j)^2 + x(j+tau)^2 over the overlap. m is updated incrementally
+        const float* window = history.data(); //circular, so index through windowSample()
+        double m = 2.0*energy;
+        for (int tau = 0; tau < static_cast<int>(nsdf.size()); ++tau)
+        {
+            if (tau > 0)
+            {
+                const double first = windowSample(window, tau-1);
+                const double last = windowSample(window, windowLength-tau);
+                m -= first*first + last*last;
+            }
+            nsdf[static_cast<size_t>(tau)] = (m > 0) ? static_cast<float>(2.0*data[tau]*autocorrelationScale/m) : 0.f;
+        }
+    }
+
+    float windowSample(const float* window, int index) const
+    {
+        return window[(historyWritePosition+index) % windowLength]; //index 0 is the oldest sample
+    }
+
+    //clarity is the height of the highest key maximum (1 = perfectly periodic), 0 if there's no pitch
+    float findFrequencyInNSDF(float& clarity) const
+    {
+        clarity = 0.f;
+        //Key maxima: the highest point of every positive lobe after the first negative-going zero crossing
+        const int maxLag = static_cast<int>(nsdf.size())-1;
+        const int minLag = juce::jmax(2, static_cast<int>(sampleRate/maxFrequency));
+
+        int tau = 1;
+        while (tau < maxLag && nsdf[static_cast<size_t>(tau)] > 0.f)
+        {
+            ++tau; //skip the lobe around lag 0
+        }
+
+        std::array<int, maxKeyMaxima> keyMaxima;
+        int numKeyMaxima = 0;
+        float highestKeyMaximum = 0.f;
+
+        while (tau < maxLag && numKeyMaxima < maxKeyMaxima)
+        {
+            while (tau < maxLag && nsdf[static_cast<size_t>(tau)] <= 0.f)
+            {
+                ++tau;
+            }
+
+            int lobeMax = tau;
+            while (tau < maxLag && nsdf[static_cast<size_t>(tau)] > 0.f)
+            {
+                if (nsdf[static_cast<size_t>(tau)] > nsdf[static_cast<size_t>(lobeMax)])
+                {
+                    lobeMax = tau;
+                }
+                ++tau;
+            }
+
+            if (tau < maxLag && lobeMax >= minLag) //a lobe cut off by maxLag isn't a real maximum
+            {
+                keyMaxima[static_cast<size_t>(numKeyMaxima++)] = lobeMax;
+                highestKeyMaximum = juce::jmax(highestKeyMaximum, nsdf[static_cast<size_t>(lobeMax)]);
+            }
+        }
+
+        if (numKeyMaxima == 0 || highestKeyMaximum < minClarity)
+        {
+            return 0.f;
+        }
+        clarity = juce::jmin(1.f, highestKeyMaximum);
+
+        int period = 0;
+        for (int i = 0; i < numKeyMaxima; ++i)
+        {
+            if (nsdf[static_cast<size_t>(keyMaxima[static_cast<size_t>(i)])] >= keyMaximumCutoff*highestKeyMaximum)
+            {
+                period = keyMaxima[static_cast<size_t>(i)];
+                break;
+            }
+        }
+
+        //The parabola through 3 points is only so accurate, and a short period makes that error a lot of cents.
+        //The key maximum nearest to k periods has k times the lag for the same error, so use the furthest one that's still clearly there
+        const float firstPeriod = interpolatePeak(period);
+        float bestPeriod = firstPeriod;
+        for (int i = 0; i < numKeyMaxima; ++i)
+        {
+            const int lag = keyMaxima[static_cast<size_t>(i)];
+            const int multiple = juce::roundToInt(lag/firstPeriod);
+            if (multiple > 1
+                && std::abs(lag - multiple*firstPeriod) < 0.5f*multiple
+                && nsdf[static_cast<size_t>(lag)] >= keyMaximumCutoff*highestKeyMaximum)
+            {
+                bestPeriod = interpolatePeak(lag)/multiple;
+            }
+        }
+
+        return static_cast<float>(sampleRate/bestPeriod);
+    }
+
+    float interpolatePeak(int tau) const
+    {
+        //Vertex of the parabola through tau-1, tau, tau+1
+        const float left = nsdf[static_cast<size_t>(tau-1)];
+        const float centre = nsdf[static_cast<size_t>(tau)];
+        const float right = nsdf[static_cast<size_t>(tau+1)];
+        const float denominator = left - 2.f*centre + right;
+        return (denominator < 0.f) ? tau + 0.5f*(left-right)/denominator : static_cast<float>(tau);
+    }
+
+    static constexpr int maxKeyMaxima = 64;
+
+    double sampleRate = 48000;
+    int hopSize = 512;
+    int windowLength = 2048;
+    std::shared_ptr<const juce::dsp::FFT> fftObject; //shared with every other estimator of this size
+
+    std::vector<float> history; //circular, windowLength samples
+    int historyWritePosition = 0; //also the oldest sample
+    int numSamplesSeen = 0; //since the last discontinuity, stops at windowLength
+
+    std::vector<float> fftBuffer; //window + zero padding, then the autocorrelation
+    std::vector<float> nsdf; //lags 0..windowLength/2-1
+};
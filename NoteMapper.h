@@ -0,0 +1,227 @@
+/*
+  ==============================================================================
+
+    NoteMapper.h
+    Frequency -> nearest note, octave and cents, from precomputed tables.
+
+    The target pitch of every MIDI note (0-127) is worked out once, when the
+    reference, temperament or stretch changes, and kept as log2(frequency).
+    A reading is then 1 log2, a rounding for the nearest equal tempered
+    note, and a step or two through the table to the nearest target. No
+    strings, no switch, nothing allocated, and the result is a plain struct.
+
+    Temperaments are cents away from equal temperament per pitch class,
+    written for a key of C and rotated to the key that's set. They're
+    normalised so A is always exactly on the reference, the way tuners do it
+    (A4 = 440 stays 440 in every temperament). Stretch tuning adds a fixed
+    number of cents per octave away from A4, eg. +1 makes the top of a
+    piano sharp and the bottom flat like a tuner's stretch curve.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+
+//The nearest note to a frequency. A plain struct, safe to copy anywhere
+struct NoteReading
+{
+    bool isValid = false; //false for silence/no reading yet, then the rest is meaningless
+    int midiNote = 0; //69 = A4. Can be outside 0-127 for readings outside the MIDI range
+    int noteIndex = 0; //0 = C, 1 = C#, ... 11 = B
+    int octave = 0; //scientific pitch notation, A4 is octave 4
+    float cents = 0; //-50..+50 (a bit more with uneven temperaments), away from the target below
+    float targetFrequency = 0; //where the note should be with this reference/temperament/stretch
+};
+
+class NoteMapper
+{
+public:
+    enum Temperament
+    {
+        equal,
+        pythagorean,
+        quarterCommaMeantone,
+        justIntonation, //5-limit major scale on the key
+        werckmeisterIII,
+        custom //setCustomTemperament
+    };
+
+    //Everything the tables are built from. Small and trivially copyable, so it can be handed to another thread
+    //(a seqlock) and the tables rebuilt there with setSettings, instead of copying the tables
+    struct Settings
+    {
+        double referenceFrequency = 440;
+        Temperament temperament = equal;
+        int key = 0;
+        float stretchCentsPerOctave = 0;
+        std::array<float, 12> customOffsets {};
+    };
+
+    static constexpr int numNotes = 128; //MIDI 0-127, 8 Hz to 12.5 kHz at A4 = 440
+    static constexpr int referenceMidiNote = 69; //A4
+    static constexpr int referenceNoteIndex = 9; //A
+
+    NoteMapper() { rebuildTables(); }
+
+    //All of these rebuild the tables (numNotes values), so call them when something changes, not per reading
+    void setReferenceFrequency(double newReferenceFrequency)
+    {
+        if (newReferenceFrequency > 0)
+        {
+            settings.referenceFrequency = newReferenceFrequency;
+            rebuildTables();
+        }
+    }
+
+    //key is the pitch class the temperament is built on, 0 = C
+    void setTemperament(Temperament newTemperament, int newKey = 0)
+    {
+        settings.temperament = newTemperament;
+        settings.key = ((newKey % 12) + 12) % 12;
+        rebuildTables();
+    }
+
+    //Cents away from equal temperament for C, C#, ... B (in the key of C, setTemperament's key still rotates it)
+    void setCustomTemperament(const std::array<float, 12>& centsFromEqual)
+    {
+        settings.customOffsets = centsFromEqual;
+        setTemperament(custom, settings.key);
+    }
+
+    void setStretch(float newCentsPerOctave)
+    {
+        settings.stretchCentsPerOctave = newCentsPerOctave;
+        rebuildTables();
+    }
+
+    //All of the above at once, 1 rebuild
+    void setSettings(const Settings& newSettings)
+    {
+        const double previousReference = settings.referenceFrequency;
+        settings = newSettings;
+        settings.key = ((settings.key % 12) + 12) % 12;
+        if (! (settings.referenceFrequency > 0))
+        {
+            settings.referenceFrequency = previousReference;
+        }
+        rebuildTables();
+    }
+
+    double getReferenceFrequency() const { return settings.referenceFrequency; }
+    Temperament getTemperament() const { return settings.temperament; }
+    int getTemperamentKey() const { return settings.key; }
+    float getStretch() const { return settings.stretchCentsPerOctave; }
+    const Settings& getSettings() const { return settings; }
+
+    NoteReading map(float frequency) const noexcept
+    {
+        NoteReading reading;
+        if (! (frequency > 0.f)) //also catches NaN
+        {
+            return reading;
+        }
+
+        double log2Frequency = std::log2(static_cast<double>(frequency));
+
+        //The equal tempered guess is never more than a note or two off, the walk finds the nearest target from there
+        int midiNote = static_cast<int>(std::lround(12*(log2Frequency - log2Reference))) + referenceMidiNote;
+
+        //Outside the table (only with a very low or high reference), look up the same note a few octaves in and move it back after
+        int octaveShift = 0;
+        if (midiNote < 0)
+        {
+            octaveShift = -((11 - midiNote)/12);
+        }
+        else if (midiNote > numNotes-1)
+        {
+            octaveShift = (midiNote - (numNotes-1) + 11)/12;
+        }
+        log2Frequency -= octaveShift;
+        midiNote -= 12*octaveShift;
+
+        auto distance = [&](int note) { return std::abs(log2Frequency - targetLog2[static_cast<size_t>(note)]); };
+        while (midiNote > 0 && distance(midiNote-1) < distance(midiNote))
+        {
+            --midiNote;
+        }
+        while (midiNote < numNotes-1 && distance(midiNote+1) < distance(midiNote))
+        {
+            ++midiNote;
+        }
+
+        const double centsFromTarget = 1200*(log2Frequency - targetLog2[static_cast<size_t>(midiNote)]) - settings.stretchCentsPerOctave*octaveShift;
+        midiNote += 12*octaveShift;
+
+        reading.isValid = true;
+        reading.midiNote = midiNote;
+        reading.noteIndex = ((midiNote % 12) + 12) % 12;
+        reading.octave = (midiNote - reading.noteIndex)/12 - 1;
+        reading.cents = static_cast<float>(centsFromTarget);
+        reading.targetFrequency = (octaveShift == 0) ? targetFrequencies[static_cast<size_t>(midiNote)]
+                                                     : static_cast<float>(frequency*std::exp2(-centsFromTarget/1200));
+        return reading;
+    }
+
+    //For display. The sharp is separate so the editor can draw it smaller
+    static const char* getNoteLetter(int noteIndex)
+    {
+        static constexpr const char* letters[12] = { "C", "C", "D", "D", "E", "F", "F", "G", "G", "A", "A", "B" };
+        return letters[((noteIndex % 12) + 12) % 12];
+    }
+
+    static bool isSharp(int noteIndex)
+    {
+        static constexpr bool sharps[12] = { false, true, false, true, false, false, true, false, true, false, true, false };
+        return sharps[((noteIndex % 12) + 12) % 12];
+    }
+
+    //Cents away from equal temperament, C to B, in the key of C
+    static std::array<float, 12> getTemperamentOffsets(Temperament temperamentToGet)
+    {
+        switch (temperamentToGet)
+        {
+            //Pure 3:2 fifths from Eb to G#
+            case pythagorean:          return {{ 0.f, 13.69f, 3.91f, -5.87f, 7.82f, -1.96f, 11.73f, 1.96f, 15.64f, 5.87f, -3.91f, 9.78f }};
+            //Fifths narrowed by 1/4 of the syntonic comma, so the major thirds are pure
+            case quarterCommaMeantone: return {{ 0.f, -23.95f, -6.84f, 10.26f, -13.69f, 3.42f, -20.53f, -3.42f, -27.37f, -10.26f, 6.84f, -17.11f }};
+            //1:1 16:15 9:8 6:5 5:4 4:3 45:32 3:2 8:5 5:3 9:5 15:8
+            case justIntonation:       return {{ 0.f, 11.73f, 3.91f, 15.64f, -13.69f, -1.96f, -9.78f, 1.96f, 13.69f, -15.64f, 17.60f, -11.73f }};
+            case werckmeisterIII:      return {{ 0.f, -9.78f, -7.82f, -5.87f, -9.78f, -1.96f, -11.73f, -3.91f, -7.82f, -11.73f, -3.91f, -7.82f }};
+            case equal:
+            case custom:
+            default:                   return {};
+        }
+    }
+
+private:
+    void rebuildTables()
+    {
+        const std::array<float, 12> inC = (settings.temperament == custom) ? settings.customOffsets : getTemperamentOffsets(settings.temperament);
+
+        //Rotate to the key, then move everything so A has no offset (A4 stays on the reference)
+        std::array<double, 12> offsets {};
+        for (int pitchClass = 0; pitchClass < 12; ++pitchClass)
+        {
+            offsets[static_cast<size_t>(pitchClass)] = inC[static_cast<size_t>((pitchClass - settings.key + 12) % 12)];
+        }
+        const double referenceOffset = offsets[referenceNoteIndex];
+
+        log2Reference = std::log2(settings.referenceFrequency);
+        for (int note = 0; note < numNotes; ++note)
+        {
+            const double semitonesFromReference = note - referenceMidiNote;
+            const double cents = offsets[static_cast<size_t>(note % 12)] - referenceOffset + settings.stretchCentsPerOctave*semitonesFromReference/12;
+            targetLog2[static_cast<size_t>(note)] = log2Reference + semitonesFromReference/12 + cents/1200;
+            targetFrequencies[static_cast<size_t>(note)] = static_cast<float>(std::exp2(targetLog2[static_cast<size_t>(note)]));
+        }
+    }
+
+    Settings settings;
+
+    double log2Reference = 0;
+    std::array<double, numNotes> targetLog2 {};
+    std::array<float, numNotes> targetFrequencies {};
+};
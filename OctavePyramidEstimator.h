@@ -0,0 +1,455 @@
+/*
+  ==============================================================================
+
+    OctavePyramidEstimator.h
+    Multirate pitch detection: a cascade of half-band decimators, each level
+    with the same small FFT, and each level responsible for 1 octave.
+
+    The single rate FFT needs its longest window (8192 at 48 kHz) for the
+    lowest note it reads, and then every note pays for that window. Here
+    level k runs at sampleRate/2^k, so the same 512 point FFT is twice as
+    long in time at every level down: 11 ms at the top, 341 ms at the bottom
+    (48 kHz), and the bands are [8, 16) bins of their level, so every octave
+    gets the same resolution in cents (constant Q). A note is read from the
+    level whose band it's in, so a treble note only waits for the short
+    windows and a low A (27.5 Hz) still gets 8 periods.
+
+    Every level keeps its own history and its last frame. Its exact frequency
+    comes from the phase difference between 2 frames, like the phase vocoder:
+    the frame of the previous hop if it's at most fftSize/4 back, otherwise
+    a frame fftSize/4 before the newest one (computed only when the level
+    has a peak).
+
+    The pitch is the strongest band peak, unless a lower band has a peak
+    that it's a harmonic of (within 30 cents) and that isn't more than 20dB
+    weaker, the same rule as the phase vocoder's harmonic checker.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "PitchEstimator.h"
+#include "PolyphaseDecimator.h"
+#include "SharedFFTResources.h"
+
+class OctavePyramidEstimator : public PitchEstimator
+{
+public:
+    juce::String getName() const override { return "Octave pyramid"; }
+
+    void prepare(double sampleRateToUse, int hopSizeToUse) override
+    {
+        sampleRate = sampleRateToUse;
+        hopSize = hopSizeToUse;
+
+        fftObject = SharedFFTResources::getFFT(fftOrder);
+        window = SharedFFTResources::getWindow(fftSize, SharedFFTResources::WindowType::blackmanHarris);
+
+        //As many octaves down as it takes for the bottom band to reach minFrequency
+        numLevels = 1;
+        while (numLevels < maxLevels && getBandLowFrequency(numLevels-1) > minFrequency)
+        {
+            ++numLevels;
+        }
+
+        int settleSamples = 0;
+        for (int k = 0; k < numLevels; ++k)
+        {
+            Level& level = levels[static_cast<size_t>(k)];
+            level.sampleRate = sampleRate/(1 << k);
+            level.maxHopSamples = hopSize/(1 << k) + 2; //+1 for rounding, +1 for the sample the decimator held back
+
+            if (k > 0)
+            {
+                //Half-band: keeps a quarter of the output rate, 4 times the top of this level's band, and nothing aliases
+                level.decimator.prepare(levels[static_cast<size_t>(k-1)].sampleRate, 2, halfBandPassbandFraction*level.sampleRate);
+                level.decimatorInput.assign(static_cast<size_t>(levels[static_cast<size_t>(k-1)].maxHopSamples + 1), 0.f);
+                level.samples.assign(static_cast<size_t>(level.maxHopSamples), 0.f);
+
+                //After a reset the filters above this level ring for their length before the output means anything
+                settleSamples = settleSamples/2 + level.decimator.getNumTaps()/2;
+            }
+            level.settleSamples = settleSamples;
+
+            level.lowBin = minBandBin;
+            level.highBin = (k == 0) ? juce::jlimit(minBandBin+1, fftSize/2 - 1, static_cast<int>(std::ceil(maxFrequency*fftSize/level.sampleRate)) + 1)
+                                     : 2*minBandBin;
+
+            level.history.assign(static_cast<size_t>(historySize), 0.f);
+            level.spectrum.assign(static_cast<size_t>(2*fftSize), 0.f); //the real only FFT needs 2*size
+            level.previousSpectrum.assign(static_cast<size_t>(2*fftSize), 0.f);
+        }
+
+        for (int k = numLevels; k < maxLevels; ++k)
+        {
+            levels[static_cast<size_t>(k)] = Level(); //a smaller pyramid than last time gives the memory back
+        }
+
+        readingLevel = numLevels-1;
+        reset();
+    }
+
+    bool processHop(const float* hopSamples, int numSamples, juce::int64 endSample, PitchReading& reading) override
+    {
+        feedLevels(hopSamples, numSamples);
+
+        if (levels[0].numSamplesSeen < historySize)
+        {
+            return false; //not even the shortest window is full yet
+        }
+
+        reading.sampleTime = endSample;
+
+        //Every level that's full and has enough new samples makes a new frame and looks for a peak in its band
+        int strongestLevel = -1;
+        for (int k = 0; k < numLevels; ++k)
+        {
+            Level& level = levels[static_cast<size_t>(k)];
+            updateCandidate(level);
+            if (level.candidate.isValid && (strongestLevel < 0 || level.candidate.magnitude > levels[static_cast<size_t>(strongestLevel)].candidate.magnitude))
+            {
+                strongestLevel = k;
+            }
+        }
+
+        if (strongestLevel < 0)
+        {
+            reading.frequency = 0.f;
+            reading.magnitude = 0.f;
+            return true;
+        }
+
+        //Lowest band first: the lowest peak the strongest one is a harmonic of is the fundamental
+        int fundamentalLevel = strongestLevel;
+        const Candidate& strongest = levels[static_cast<size_t>(strongestLevel)].candidate;
+        for (int k = numLevels-1; k > strongestLevel; --k)
+        {
+            //After a gap the short windows fill first. Until every band its fundamental could be in has filled, a strong harmonic would read as the note
+            if (levels[static_cast<size_t>(k)].numSamplesSeen < historySize && 2.0*getBandLowFrequency(k)*maxHarmonic > strongest.frequency)
+            {
+                return false;
+            }
+
+            const Candidate& lower = levels[static_cast<size_t>(k)].candidate;
+            if (lower.isValid && isHarmonicOf(strongest, lower))
+            {
+                fundamentalLevel = k;
+                break;
+            }
+        }
+
+        const Candidate& fundamental = levels[static_cast<size_t>(fundamentalLevel)].candidate;
+        readingLevel = fundamentalLevel;
+        reading.frequency = fundamental.frequency;
+        reading.magnitude = fundamental.magnitude*(1 << fundamentalLevel); //on the scale of an FFT as long as this level's window
+        reading.confidence = fundamental.confidence;
+        return true;
+    }
+
+    void skipHop(const float* hopSamples, int numSamples) override
+    {
+        feedLevels(hopSamples, numSamples); //no FFTs. A level whose last frame is now too far back makes a new pair next time
+    }
+
+    void handleDiscontinuity() override
+    {
+        //The gap can be anywhere in the next hop, so count that whole hop as old, and the filters start again from silence
+        for (int k = 0; k < numLevels; ++k)
+        {
+            Level& level = levels[static_cast<size_t>(k)];
+            level.numSamplesSeen = -level.maxHopSamples - level.settleSamples;
+            level.decimator.reset();
+            level.numPendingInput = 0;
+            level.hasPreviousFrame = false;
+            level.candidate = Candidate();
+        }
+    }
+
+    int getWindowLength() const override { return fftSize << readingLevel; } //in input samples, of the level the last reading came from
+
+    size_t getMemoryBytes() const override
+    {
+        size_t numBytes = 0;
+        for (const Level& level : levels)
+        {
+            numBytes += (level.history.capacity() + level.spectrum.capacity() + level.previousSpectrum.capacity()
+                         + level.decimatorInput.capacity() + level.samples.capacity())*sizeof(float)
+                        + level.decimator.getMemoryBytes();
+        }
+        return numBytes;
+    }
+
+    int getNumLevels() const { return numLevels; }
+
+private:
+    static constexpr int fftOrder = 9;
+    static constexpr int fftSize = 1 << fftOrder; //every level
+    static constexpr int maxFrameLag = fftSize/4; //the phase difference only unwraps correctly up to here (same as the phase vocoder's hop)
+    static constexpr int minFrameLag = maxFrameLag/4; //a level with fewer new samples than this keeps its last peak, the phase moved too little
+    static constexpr int historySize = fftSize + maxFrameLag; //room for the frame maxFrameLag back
+    static constexpr int maxLevels = 8;
+    static constexpr int minBandBin = 8; //a band is [8, 16) bins of its level: 8 periods of its lowest note in the window
+    static constexpr double minFrequency = 26.0; //a bit under the low A of a piano
+    static constexpr double maxFrequency = 4200.0; //the top note of a piano
+    static constexpr double halfBandPassbandFraction = 0.125; //of a level's rate
+    static constexpr float silenceThreshold = 0.001f*fftSize; //-60dB, same as the phase vocoder's (0.001*fftLength on a bin)
+    static constexpr float maxFundamentalRatio = 10.f; //a fundamental more than 20dB under its harmonic isn't believed (fundamentalFrequencyChecker)
+    static constexpr int maxHarmonic = 8;
+    static constexpr float harmonicToleranceCents = 30.f; //strings are a bit inharmonic, the upper partials run sharp
+    static constexpr float fullConfidenceDecibelsAboveThreshold = 30.f;
+
+    struct Candidate
+    {
+        bool isValid = false;
+        float magnitude = 0.f; //the band's peak bin, at this level's FFT scale
+        float frequency = 0.f; //from the phase difference
+        float confidence = 0.f;
+    };
+
+    struct Level
+    {
+        double sampleRate = 48000;
+        int maxHopSamples = 0; //the most samples a hop can bring at this level's rate
+        int lowBin = minBandBin, highBin = 2*minBandBin; //the band, [lowBin, highBin)
+        int settleSamples = 0; //of the decimators above, see handleDiscontinuity
+
+        PolyphaseDecimator decimator; //from the level above. Not used on level 0
+        std::vector<float> decimatorInput; //the level above's hop, after the sample the decimator held back last time
+        int numPendingInput = 0; //0 or 1: the decimator takes pairs
+        std::vector<float> samples; //this hop at this level's rate
+
+        std::vector<float> history; //circular, historySize samples
+        int historyWritePosition = 0; //also the oldest sample
+        int numSamplesSeen = 0; //since the last discontinuity, stops at historySize
+
+        std::vector<float> spectrum, previousSpectrum; //the newest frame and the one before it
+        bool hasPreviousFrame = false;
+        int samplesSincePreviousFrame = 0; //stops at historySize
+
+        Candidate candidate; //the band's peak from the newest frame
+    };
+
+    //The lowest frequency of level k's band
+    double getBandLowFrequency(int k) const { return minBandBin*sampleRate/(fftSize*static_cast<double>(1 << k)); }
+
+    void reset()
+    {
+        for (int k = 0; k < numLevels; ++k)
+        {
+            Level& level = levels[static_cast<size_t>(k)];
+            level.decimator.reset();
+            level.numPendingInput = 0;
+            level.historyWritePosition = 0;
+            level.numSamplesSeen = -level.settleSamples;
+            level.hasPreviousFrame = false;
+            level.samplesSincePreviousFrame = 0;
+            level.candidate = Candidate();
+        }
+    }
+
+    void feedLevels(const float* hopSamples, int numSamples)
+    {
+        //Hops longer than the one we were prepared for (the buffers are sized for it) go through in pieces
+        while (numSamples > 0)
+        {
+            const int numThisTime = juce::jmin(numSamples, hopSize);
+            const float* levelSamples = hopSamples;
+            int numLevelSamples = numThisTime;
+
+            for (int k = 0; k < numLevels; ++k)
+            {
+                Level& level = levels[static_cast<size_t>(k)];
+                if (k > 0)
+                {
+                    //The decimator takes pairs, so an odd sample waits for the next hop at the front of decimatorInput
+                    juce::FloatVectorOperations::copy(level.decimatorInput.data() + level.numPendingInput, levelSamples, numLevelSamples);
+                    const int numInput = level.numPendingInput + numLevelSamples;
+                    const int numPairs = numInput/2;
+
+                    numLevelSamples = level.decimator.process(level.decimatorInput.data(), 2*numPairs, level.samples.data());
+                    level.numPendingInput = numInput - 2*numPairs;
+                    if (level.numPendingInput > 0)
+                    {
+                        level.decimatorInput[0] = level.decimatorInput[static_cast<size_t>(numInput-1)];
+                    }
+                    levelSamples = level.samples.data();
+                }
+
+                writeToHistory(level, levelSamples, numLevelSamples);
+            }
+
+            hopSamples += numThisTime;
+            numSamples -= numThisTime;
+        }
+    }
+
+    void writeToHistory(Level& level, const float* samples, int numSamples)
+    {
+        level.numSamplesSeen = juce::jmin(level.numSamplesSeen+numSamples, historySize); //(negative after a discontinuity)
+        level.samplesSincePreviousFrame = juce::jmin(level.samplesSincePreviousFrame+numSamples, historySize);
+
+        //Only the newest historySize samples matter
+        if (numSamples >= historySize)
+        {
+            samples += numSamples-historySize;
+            numSamples = historySize;
+        }
+
+        const int numUntilEnd = juce::jmin(numSamples, historySize-level.historyWritePosition);
+        juce::FloatVectorOperations::copy(level.history.data()+level.historyWritePosition, samples, numUntilEnd);
+        juce::FloatVectorOperations::copy(level.history.data(), samples+numUntilEnd, numSamples-numUntilEnd);
+        level.historyWritePosition = (level.historyWritePosition+numSamples) % historySize;
+    }
+
+    //Windowed FFT of the fftSize samples that end samplesBeforeNewest before the newest one. Positive frequencies only
+    void computeFrame(const Level& level, int samplesBeforeNewest, float* frame) const
+    {
+        int start = level.historyWritePosition - samplesBeforeNewest - fftSize;
+        while (start < 0)
+        {
+            start += historySize;
+        }
+
+        const float* windowTable = window->data();
+        const int numUntilEnd = juce::jmin(fftSize, historySize-start);
+        juce::FloatVectorOperations::multiply(frame, level.history.data()+start, windowTable, numUntilEnd);
+        juce::FloatVectorOperations::multiply(frame+numUntilEnd, level.history.data(), windowTable+numUntilEnd, fftSize-numUntilEnd);
+        fftObject->performRealOnlyForwardTransform(frame, true);
+    }
+
+    static float binMagnitude(const float* frame, int bin) { return std::hypot(frame[2*bin], frame[2*bin+1]); }
+
+    static bool isLocalMaximum(const float* frame, int bin)
+    {
+        const float magnitude = binMagnitude(frame, bin);
+        return magnitude > binMagnitude(frame, bin-1) && magnitude > binMagnitude(frame, bin+1);
+    }
+
+    //spectrum is the newest frame, previousSpectrum the one frameLag samples before it
+    Candidate makeCandidate(const Level& level, int bin, int frameLag) const
+    {
+        const float* frame = level.spectrum.data();
+        const float* previousFrame = level.previousSpectrum.data();
+        const float previousPhase = std::atan2(previousFrame[2*bin+1], previousFrame[2*bin]);
+        const float phase = std::atan2(frame[2*bin+1], frame[2*bin]);
+
+        Candidate candidate;
+        candidate.isValid = true;
+        candidate.magnitude = binMagnitude(frame, bin);
+        candidate.frequency = phaseDifferenceToFrequency(level, bin, previousPhase, phase, frameLag);
+        candidate.confidence = getConfidence(level, bin, candidate.frequency, candidate.magnitude);
+        return candidate;
+    }
+
+    void updateCandidate(Level& level)
+    {
+        if (level.numSamplesSeen < historySize)
+        {
+            level.candidate = Candidate(); //the window still reaches back past the start (or a gap)
+            level.hasPreviousFrame = false;
+            return;
+        }
+        if (level.hasPreviousFrame && level.samplesSincePreviousFrame < minFrameLag)
+        {
+            return; //the low levels only get a few samples a hop. Their last peak stands until there are enough for a new one
+        }
+
+        computeFrame(level, 0, level.spectrum.data());
+        const float* frame = level.spectrum.data();
+
+        //The band's biggest bin, if it's a peak and not the skirt of one just outside the band (isLocalMaximum)
+        int peakBin = level.lowBin;
+        for (int bin = level.lowBin+1; bin < level.highBin; ++bin)
+        {
+            if (binMagnitude(frame, bin) > binMagnitude(frame, peakBin))
+            {
+                peakBin = bin;
+            }
+        }
+        const float peakMagnitude = binMagnitude(frame, peakBin);
+
+        level.candidate = Candidate();
+        if (peakMagnitude >= silenceThreshold && isLocalMaximum(frame, peakBin))
+        {
+            //The frame to take the phase difference against: the last one if it's close enough, otherwise 1 made for it
+            int frameLag = level.samplesSincePreviousFrame;
+            if (! level.hasPreviousFrame || frameLag > maxFrameLag)
+            {
+                frameLag = maxFrameLag;
+                computeFrame(level, frameLag, level.previousSpectrum.data());
+            }
+            level.candidate = makeCandidate(level, peakBin, frameLag);
+
+            //The top band is wider than an octave, so it can hold a note and its own harmonics. Lowest fundamental first
+            for (int harmonicNumber = maxHarmonic; harmonicNumber >= 2; --harmonicNumber)
+            {
+                const int bin = juce::roundToInt(static_cast<float>(peakBin)/harmonicNumber);
+                if (bin < level.lowBin)
+                {
+                    continue;
+                }
+
+                int subPeakBin = juce::jmax(level.lowBin, bin-1);
+                for (int neighbour = bin; neighbour <= bin+1; ++neighbour)
+                {
+                    subPeakBin = (binMagnitude(frame, neighbour) > binMagnitude(frame, subPeakBin)) ? neighbour : subPeakBin;
+                }
+                if (binMagnitude(frame, subPeakBin) < silenceThreshold || ! isLocalMaximum(frame, subPeakBin))
+                {
+                    continue;
+                }
+
+                const Candidate subPeak = makeCandidate(level, subPeakBin, frameLag);
+                if (isHarmonicOf(level.candidate, subPeak))
+                {
+                    level.candidate = subPeak;
+                    break;
+                }
+            }
+        }
+
+        std::swap(level.spectrum, level.previousSpectrum);
+        level.hasPreviousFrame = true;
+        level.samplesSincePreviousFrame = 0;
+    }
+
+    static float phaseDifferenceToFrequency(const Level& level, int binNumber, float previousPhase, float phase, int frameLag)
+    {
+        //Same as the phase vocoder's, with this level's rate and however far apart these 2 frames are
+        float phaseRemainder = (phase-previousPhase) - frameLag*juce::MathConstants<float>::twoPi*binNumber/fftSize;
+        phaseRemainder = std::remainder(phaseRemainder, juce::MathConstants<float>::twoPi); //angle wrap from -pi to pi
+
+        const float exactOmega = phaseRemainder/frameLag + juce::MathConstants<float>::twoPi*binNumber/fftSize;
+        return static_cast<float>(level.sampleRate*exactOmega/juce::MathConstants<float>::twoPi);
+    }
+
+    static float getConfidence(const Level& level, int binNumber, float frequency, float magnitude)
+    {
+        //Like the phase vocoder's: full at 30dB over the threshold, and 0 when the phase difference puts the frequency a bin away from the peak
+        const float levelConfidence = juce::jlimit(0.f, 1.f, juce::Decibels::gainToDecibels(magnitude/silenceThreshold)/fullConfidenceDecibelsAboveThreshold);
+        const float binOffset = std::abs(frequency*fftSize/static_cast<float>(level.sampleRate) - binNumber);
+        return levelConfidence*juce::jlimit(0.f, 1.f, 2.f*(1.f - binOffset));
+    }
+
+    static bool isHarmonicOf(const Candidate& harmonic, const Candidate& fundamental)
+    {
+        if (fundamental.frequency <= 0.f || fundamental.magnitude*maxFundamentalRatio < harmonic.magnitude)
+        {
+            return false;
+        }
+
+        const float ratio = harmonic.frequency/fundamental.frequency;
+        const int harmonicNumber = juce::roundToInt(ratio);
+        return harmonicNumber >= 2 && harmonicNumber <= maxHarmonic
+               && std::abs(1200.f*std::log2(ratio/harmonicNumber)) < harmonicToleranceCents;
+    }
+
+    double sampleRate = 48000;
+    int hopSize = 512;
+    int numLevels = 1;
+    int readingLevel = 0; //the level the last reading came from
+    std::shared_ptr<const juce::dsp::FFT> fftObject; //shared with every other estimator of this size
+    std::shared_ptr<const std::vector<float>> window;
+    std::array<Level, maxLevels> levels;
+};
@@ -0,0 +1,135 @@
+/*
+  ==============================================================================
+
+    PackedRealFFT.h
+    An in-place real FFT that only needs size+2 floats, for low memory mode.
+
+    juce::dsp::FFT's real only transform wants 2*size floats, even when
+    only the non-negative frequencies are asked for, and at order8192 that
+    workspace was most of a low memory instance. This packs the size real
+    samples into size/2 complex ones (even samples real, odd ones
+    imaginary), does a size/2 point complex FFT in place, and then splits
+    the result into the size/2+1 bins of the real signal, 2 bins at a time
+    so that's in place as well.
+
+    The output is laid out like juce::dsp::FFT's: interleaved real and
+    imaginary parts, bin 0 to bin size/2. The values agree with it to float
+    rounding. It's a plain radix-2 FFT, slower than the platform FFTs JUCE
+    can use, which is the price of the memory.
+
+    The twiddle table (size/2 complex values) never changes after it's
+    built, so one plan per order is shared by every instance
+    (SharedFFTResources::getPackedRealFFT), like juce::dsp::FFT's plans.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+class PackedRealFFT
+{
+public:
+    explicit PackedRealFFT(int orderToUse) : order(orderToUse), size(1 << orderToUse)
+    {
+        jassert(order >= 2);
+
+        //e^(-2 pi i k/size). The complex FFT of size/2 uses every other one, the split uses the first quarter
+        twiddles.resize(static_cast<size_t>(size));
+        for (int k = 0; k < size/2; ++k)
+        {
+            const double angle = -2.0*juce::MathConstants<double>::pi*k/size;
+            twiddles[static_cast<size_t>(2*k)] = static_cast<float>(std::cos(angle));
+            twiddles[static_cast<size_t>(2*k+1)] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    int getOrder() const noexcept { return order; }
+    int getSize() const noexcept { return size; }
+
+    //data holds size real samples, and gets bins 0 to size/2 back as interleaved complex numbers, so it needs size+2 floats
+    void performRealOnlyForwardTransform(float* data) const noexcept
+    {
+        const int numComplex = size/2;
+        performComplex(data, numComplex);
+
+        //z = the packed FFT. Bin k of the real signal is E + W^k*O, with E = (z[k] + conj(z[n-k]))/2 the even samples' spectrum
+        //and O = (z[k] - conj(z[n-k]))/2i the odd ones'. Bin n-k is conj(E - W^k*O), so each pair only needs its own 2 slots
+        const float dcReal = data[0], dcImag = data[1];
+        data[0] = dcReal + dcImag;
+        data[1] = 0.f;
+        data[size] = dcReal - dcImag;
+        data[size+1] = 0.f;
+
+        for (int k = 1; k <= numComplex/2; ++k)
+        {
+            const int mirror = numComplex - k;
+            const float aReal = data[2*k], aImag = data[2*k+1];
+            const float bReal = data[2*mirror], bImag = data[2*mirror+1];
+
+            const float evenReal = 0.5f*(aReal + bReal), evenImag = 0.5f*(aImag - bImag);
+            const float oddReal = 0.5f*(aImag + bImag), oddImag = -0.5f*(aReal - bReal);
+
+            const float wReal = twiddles[static_cast<size_t>(2*k)], wImag = twiddles[static_cast<size_t>(2*k+1)];
+            const float tReal = wReal*oddReal - wImag*oddImag;
+            const float tImag = wReal*oddImag + wImag*oddReal;
+
+            data[2*k] = evenReal + tReal;
+            data[2*k+1] = evenImag + tImag;
+            data[2*mirror] = evenReal - tReal; //when k == mirror this is the same value again
+            data[2*mirror+1] = tImag - evenImag;
+        }
+    }
+
+    size_t getMemoryBytes() const { return twiddles.size()*sizeof(float); }
+
+private:
+    //In place radix-2 decimation in time on n interleaved complex numbers
+    void performComplex(float* data, int n) const noexcept
+    {
+        for (int i = 1, j = 0; i < n; ++i)
+        {
+            int bit = n >> 1;
+            for (; (j & bit) != 0; bit >>= 1)
+            {
+                j ^= bit;
+            }
+            j ^= bit;
+
+            if (i < j)
+            {
+                std::swap(data[2*i], data[2*j]);
+                std::swap(data[2*i+1], data[2*j+1]);
+            }
+        }
+
+        for (int length = 2; length <= n; length <<= 1)
+        {
+            const int half = length/2;
+            const int twiddleStep = 2*(size/length); //W_length^j is twiddle j*size/length, and they're interleaved
+            for (int start = 0; start < n; start += length)
+            {
+                for (int j = 0; j < half; ++j)
+                {
+                    const float wReal = twiddles[static_cast<size_t>(j*twiddleStep)], wImag = twiddles[static_cast<size_t>(j*twiddleStep+1)];
+                    float* top = data + 2*(start+j);
+                    float* bottom = top + 2*half;
+                    const float oddReal = wReal*bottom[0] - wImag*bottom[1];
+                    const float oddImag = wReal*bottom[1] + wImag*bottom[0];
+                    bottom[0] = top[0] - oddReal;
+                    bottom[1] = top[1] - oddImag;
+                    top[0] += oddReal;
+                    top[1] += oddImag;
+                }
+            }
+        }
+    }
+
+    const int order;
+    const int size;
+    std::vector<float> twiddles; //interleaved, size/2 complex values
+};
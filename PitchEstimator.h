@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    PitchEstimator.h
+    The interface every pitch detection backend implements.
+    SimpleTunerAudioProcessor pulls hops out of its AudioBufferFifo and hands
+    each one to the active estimator. The estimator keeps whatever history it
+    needs and reports a reading when it has one.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+struct PitchReading
+{
+    float frequency = -1.f; //Hz. 0 means below the noise threshold/unpitched
+    float magnitude = 0.f; //same scale as an FFT bin of the estimator's window: a sine of amplitude A gives A*windowLength/2
+    juce::int64 sampleTime = 0; //stream position just after the newest sample the reading used
+    float confidence = 0.f; //0..1, how sure the estimator is that frequency is the pitch. 0 with no pitch
+};
+
+class PitchEstimator
+{
+public:
+    virtual ~PitchEstimator() = default;
+
+    virtual juce::String getName() const = 0;
+
+    //Not realtime safe. Allocate everything here. Called from prepareToPlay
+    virtual void prepare(double sampleRate, int hopSize) = 0;
+
+    //Realtime safe. hopSamples are the numSamples newest samples, endSample is the stream position just after the last one.
+    //Returns true and fills reading if this hop gave a new reading
+    virtual bool processHop(const float* hopSamples, int numSamples, juce::int64 endSample, PitchReading& reading) = 0;
+    
+    //Realtime safe. Keeps the history going without analysing, for when the analysis has fallen behind (see OverloadPolicy).
+    //The next reading may take a hop or two longer than usual
+    virtual void skipHop(const float* hopSamples, int numSamples) = 0;
+    
+    //Realtime safe. Samples were lost somewhere inside the hop that comes next. No reading may use a window
+    //that reaches back past the start of that hop, so the estimator waits for a full window of new samples
+    virtual void handleDiscontinuity() = 0;
+
+    //How many samples of history the last reading looked at. Together with the hop this is the latency to a reading
+    virtual int getWindowLength() const = 0;
+    
+    //Heap memory this estimator holds right now (history, FFT buffers...). Not counting what's shared with other instances
+    virtual size_t getMemoryBytes() const = 0;
+};
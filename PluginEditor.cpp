@@ -20,11 +20,19 @@ SimpleTunerAudioProcessorEditor::SimpleTunerAudioProcessorEditor (SimpleTunerAud
     
     addAndMakeVisible(chromaticButton);
     addAndMakeVisible(strobeButton);
+    addAndMakeVisible(strumButton);
     addAndMakeVisible(refPlusButton);
     addAndMakeVisible(refMinusButton);
+    setOpaque(true); //the background layer covers everything, so nothing behind us has to be repainted
     
     meterRectangles.resize(2*numMeterRectsPerSide+1);
     
+    for (int noteIndex = 0; noteIndex < 12; ++noteIndex)
+    {
+        noteLetters[static_cast<size_t>(noteIndex)] = NoteMapper::getNoteLetter(noteIndex);
+        noteNames[static_cast<size_t>(noteIndex)] = noteLetters[static_cast<size_t>(noteIndex)] + (NoteMapper::isSharp(noteIndex) ? "#" : "");
+    }
+    
     startTimerHz(refreshRate); //from juce::Timer, this is why we inherited that
     
     setSize (400, 300); //setSize calls resized, so it should be the last thing...
@@ -37,15 +45,32 @@ SimpleTunerAudioProcessorEditor::~SimpleTunerAudioProcessorEditor()
 //==============================================================================
 void SimpleTunerAudioProcessorEditor::paint (juce::Graphics& g)
 {
+    //Usually only the regions repaintChangedRegions marked get here (the clip region), and most of that is a copy of a cached layer
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (backgroundLayer.isNull() || scale != layerScale)
+    {
+        renderLayers(scale); //first paint, after invalidateLayers, or the window moved to a screen with another scale
+    }
+    
     // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+    g.drawImage(backgroundLayer, getLocalBounds().toFloat());
         
+    if (meterMode == MeterMode::Strum)
+    {
+        drawStrumMeter(g);
+    }
+    else
+    {
+        drawNote(g);
+        
+        (meterMode == MeterMode::Strobe) ? drawStrobe(g) : drawMeterRectangles(g);
+        drawTriangles(g);
+    }
     
-    drawNote(g);
-    
-    drawMeterRectangles(g);
-    drawTriangles(g);
-    drawReferenceText(g);
+    if (showDebugOverlay)
+    {
+        drawDebugOverlay(g);
+    }
 }
 
 void SimpleTunerAudioProcessorEditor::resized()
@@ -68,6 +93,77 @@ void SimpleTunerAudioProcessorEditor::resized()
     initializeMeterTriangles();
     initializeModeButtons();
     initializeRefButtons();
+    initializeStrumRows();
+    invalidateLayers();
+}
+
+void SimpleTunerAudioProcessorEditor::renderLayers(float scale)
+{
+    layerScale = scale;
+    
+    //Background: everything that's drawn the same whatever the reading is
+    backgroundLayer = juce::Image(juce::Image::RGB, juce::jmax(1, juce::roundToInt(getWidth()*scale)), juce::jmax(1, juce::roundToInt(getHeight()*scale)), false);
+    {
+        juce::Graphics g (backgroundLayer);
+        g.addTransform(juce::AffineTransform::scale(scale));
+        g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+        
+        if (meterMode == MeterMode::Strum)
+        {
+            drawStrumBars(g);
+        }
+        else
+        {
+            if (meterMode == MeterMode::Strobe)
+            {
+                g.setColour(juce::Colours::darkred);
+                g.fillRect(getStrobeBand()); //1 band, the bars slide over it
+            }
+            else
+            {
+                for (int i = 0; i < meterRectangles.size(); ++i)
+                {
+                    g.setColour(getMeterRectangleColour(i, false));
+                    g.fillRect(meterRectangles.rectangles.at(i));
+                }
+            }
+            
+            g.setColour(juce::Colours::darkred);
+            g.fillPath(meterTriangles.triangles.at(0));
+            g.setColour(juce::Colours::darkgreen);
+            g.fillPath(meterTriangles.triangles.at(1));
+            g.setColour(juce::Colours::darkred);
+            g.fillPath(meterTriangles.triangles.at(2));
+        }
+        drawReferenceText(g);
+    }
+    
+    //Note glyphs: the fonts and the glyph layout only happen here, paint just copies one of these
+    for (int noteIndex = 0; noteIndex < 12; ++noteIndex)
+    {
+        auto& layer = noteGlyphLayers[static_cast<size_t>(noteIndex)];
+        layer = juce::Image(juce::Image::ARGB, juce::jmax(1, juce::roundToInt(noteArea.getWidth()*scale)), juce::jmax(1, juce::roundToInt(noteArea.getHeight()*scale)), true);
+        
+        juce::Graphics g (layer);
+        g.addTransform(juce::AffineTransform::translation(static_cast<float>(-noteArea.getX()), static_cast<float>(-noteArea.getY())).scaled(scale));
+        drawNoteGlyph(g, noteIndex);
+    }
+}
+
+void SimpleTunerAudioProcessorEditor::invalidateLayers()
+{
+    backgroundLayer = juce::Image();
+    rememberPaintedState();
+    repaint();
+}
+
+void SimpleTunerAudioProcessorEditor::rememberPaintedState()
+{
+    paintedState.noteIndex = getDisplayedNoteIndex();
+    paintedState.rectangleStatus = meterRectangles.rectangleStatus; //the same size every time, so this doesn't allocate after the first one
+    paintedState.litTriangles = getLitTriangles();
+    paintedState.numBlocksInOverlay = instrumentationSnapshot.numBlocks;
+    paintedStrumRows = strumRows;
 }
 
 void SimpleTunerAudioProcessorEditor::customizeLookAndFeel()
@@ -80,104 +176,142 @@ void SimpleTunerAudioProcessorEditor::customizeLookAndFeel()
 void SimpleTunerAudioProcessorEditor::timerCallback()
 {
     updateNoteData();
-    tunerDisplay = noteData.noteName;
-    repaint();
+    updateMeterState();
+    repaintChangedRegions();
 }
 
-void SimpleTunerAudioProcessorEditor::updateNoteData()
+void SimpleTunerAudioProcessorEditor::updateMeterState()
 {
-    //m_previousExactF = m_currentExactF; //if we wanted to average the exactF to smooth it out a bit
-    m_currentExactF = audioProcessor.getCurrentExactF();
+    if (meterMode == MeterMode::Strobe)
+    {
+        return; //the strobe band runs on the vblank (updateStrobe), the triangles only need tunerReading
+    }
+    
+    if (meterMode == MeterMode::Chromatic)
+    {
+        if (tunerReading.hasPitch())
+        {
+            setMeterRectangleStatus(tunerReading.cents);
+        }
+        else
+        {
+            resetMeterRectangleStatus();
+        }
+        return;
+    }
     
-    noteData = convertFreqToString(m_currentExactF, referenceFrequency);
+    //Strum rows: what drawStrumMeter shows, down to the marker's pixel
+    for (int row = 0; row < SimpleTunerAudioProcessor::maxPolyphonicReadings; ++row)
+    {
+        StrumRow& strumRow = strumRows[static_cast<size_t>(row)];
+        strumRow = StrumRow();
+        if (row >= m_numStrumNotes)
+        {
+            continue;
+        }
+        
+        const NoteReading stringReading = audioProcessor.getNoteMapper().map(m_strumFrequencies[static_cast<size_t>(row)]);
+        const juce::Rectangle<int>& barArea = strumBarAreas[static_cast<size_t>(row)];
+        
+        //Marker: cents -50..+50 across the bar
+        const float cents = juce::jlimit(-50.f, 50.f, stringReading.cents);
+        const int markerWidth = juce::jmax(3, barArea.getWidth()/40);
+        strumRow.hasNote = true;
+        strumRow.noteIndex = stringReading.noteIndex;
+        strumRow.markerX = barArea.getCentreX() + juce::roundToInt(cents/50.f*(barArea.getWidth()/2.f)) - markerWidth/2;
+        strumRow.inTune = std::abs(stringReading.cents) <= centTolerance;
+    }
 }
 
-
-NoteData SimpleTunerAudioProcessorEditor::convertFreqToString(float freq, float refA4)
+void SimpleTunerAudioProcessorEditor::repaintChangedRegions()
 {
-    if (freq == 0.0f) {return NoteData(juce::String(""), 0);}
-    float logRatio = std::log10( freq/refA4 )/std::log10(2);    //All of the equations are based off the log2 of freq/ref.
-                                                                //logRatio is also the number of octaves from A4 (reference)
-
-    float numSemitonesFromRef = 12*logRatio;                    //octaves -> semitones
-    int numSemitonesFromRef_round = roundf(numSemitonesFromRef);
-    float numCentsFromNote = 100*(numSemitonesFromRef-numSemitonesFromRef_round); //1 cent = 1/100 of a semitone
+    if (meterMode == MeterMode::Strum)
+    {
+        for (size_t row = 0; row < strumRows.size(); ++row)
+        {
+            if (strumRows[row] != paintedStrumRows[row])
+            {
+                repaint(strumRowAreas[row]);
+            }
+        }
+    }
+    else
+    {
+        if (getDisplayedNoteIndex() != paintedState.noteIndex)
+        {
+            repaint(noteArea);
+        }
+        
+        for (int i = 0; i < meterRectangles.size(); ++i)
+        {
+            if (static_cast<size_t>(i) >= paintedState.rectangleStatus.size() || meterRectangles.rectangleStatus.at(i) != paintedState.rectangleStatus[static_cast<size_t>(i)])
+            {
+                repaint(meterRectangles.rectangles.at(i));
+            }
+        }
+        
+        const std::array<bool, 3> litTriangles = getLitTriangles();
+        for (size_t i = 0; i < litTriangles.size(); ++i)
+        {
+            if (litTriangles[i] != paintedState.litTriangles[i])
+            {
+                repaint(meterTriangles.triangles.at(i).getBounds().getSmallestIntegerContainer().expanded(1)); //+1 for the antialiased edge
+            }
+        }
+    }
     
-    //DBG("currentExactF = " << freq << " numCentsFromNote : " << numCentsFromNote);
+    if (showDebugOverlay && instrumentationSnapshot.numBlocks != paintedState.numBlocksInOverlay)
+    {
+        repaint(getDebugOverlayArea());
+    }
+    
+    rememberPaintedState();
+}
+
+void SimpleTunerAudioProcessorEditor::updateNoteData()
+{
+    //m_previousExactF = m_currentExactF; //if we wanted to average the exactF to smooth it out a bit
+    tunerReading = audioProcessor.getCurrentReading(); //1 frame's frequency, note and cents, never a mix of 2
+    m_currentExactF = tunerReading.frequency;
     
-    juce::String noteName;
-    bool sharp = false;
+    if (meterMode == MeterMode::Strum)
+    {
+        m_numStrumNotes = audioProcessor.getPolyphonicReadings(m_strumFrequencies);
+    }
     
-    switch ( numSemitonesFromRef_round % 12 )
+    if (showDebugOverlay)
     {
+        instrumentationSnapshot = audioProcessor.getInstrumentationSnapshot();
+    }
+}
 
-        case 0: {noteName = juce::String("A"); break;}
-        
-        //A#
-        case -11:
-        case 1: {noteName = juce::String("A"); sharp=true; break;}
-
-        case -10:
-        case 2: {noteName = juce::String("B"); break;}
+void SimpleTunerAudioProcessorEditor::mouseDoubleClick(const juce::MouseEvent&)
+{
+    showDebugOverlay = ! showDebugOverlay;
+    instrumentationSnapshot = audioProcessor.getInstrumentationSnapshot();
+    repaint(getDebugOverlayArea());
+}
 
-        case -9:
-        case 3: {noteName = juce::String("C"); break;}
-        
-        //C#
-        case -8:
-        case 4: {noteName = juce::String("C"); sharp=true; break;}
 
-        case -7:
-        case 5: {noteName = juce::String("D"); break;}
-            
-        //D#
-        case -6:
-        case 6: {noteName = juce::String("D"); sharp=true; break;}
-            
-        case -5:
-        case 7: {noteName = juce::String("E"); break;}
-            
-        case -4:
-        case 8: {noteName = juce::String("F"); break;}
-        
-        //F#
-        case -3:
-        case 9: {noteName = juce::String("F"); sharp=true; break;}
-            
-        case -2:
-        case 10: {noteName = juce::String("G"); break;}
-            
-        //G#
-        case -1:
-        case 11: {noteName = juce::String("G"); sharp=true; break;}
-            
-        default: {DBG(numSemitonesFromRef_round % 12); noteName = juce::String("#"); break;}
+juce::Colour SimpleTunerAudioProcessorEditor::getMeterRectangleColour(int index, bool isLit) const
+{
+    if (index == numMeterRectsPerSide && meterMode == MeterMode::Chromatic)
+    {
+        return isLit ? juce::Colours::lightgreen : juce::Colours::darkgreen;
     }
-    return NoteData(noteName, numCentsFromNote, sharp);
+    return isLit ? juce::Colours::red : juce::Colours::darkred;
 }
 
 void SimpleTunerAudioProcessorEditor::drawMeterRectangles(juce::Graphics& g)
 {
+    //The unlit ones are already in the background layer
     for (int i = 0; i <  meterRectangles.size(); ++i)
     {
-        juce::Rectangle<int>& rect = meterRectangles.rectangles.at(i);
-        if (i == 5)
-        {
-            if (meterMode == MeterMode::Chromatic)
-            {
-            (meterRectangles.rectangleStatus.at(i)) ?  g.setColour(juce::Colours::lightgreen) : g.setColour(juce::Colours::darkgreen);
-            }
-            else if (meterMode == MeterMode::Strobe)
-            {
-                (meterRectangles.rectangleStatus.at(i)) ?  g.setColour(juce::Colours::red) : g.setColour(juce::Colours::darkred);
-            }
-        }
-        else
+        if (meterRectangles.rectangleStatus.at(i))
         {
-            (meterRectangles.rectangleStatus.at(i)) ?  g.setColour(juce::Colours::red) : g.setColour(juce::Colours::darkred);
+            g.setColour(getMeterRectangleColour(i, true));
+            g.fillRect(meterRectangles.rectangles.at(i));
         }
-        g.drawRect(rect);
-        g.fillRect(rect);
     }
 }
 
@@ -206,60 +340,131 @@ void SimpleTunerAudioProcessorEditor::setMeterRectangleStatus(float cents)
             else if (cents <= -centTolerance) {meterRectangles.rectangleStatus.at(4) = 1;}
         }
     }
-    else if (meterMode == MeterMode::Strobe)
-    {
-        float rotationsPerSecond = cents/10;    //50 -> 5 (0.2s), 10 -> 1 (1s)
-                                                //Could do better with a non-linear function?
-        int numFramesUntilAdvance = static_cast<int>(refreshRate/rotationsPerSecond);
-        if (strobeFrameCounter % numFramesUntilAdvance == 0)
-        {
-            
-            //shift everything by 1
-            if (cents < -centTolerance)
-            {
-                //rotate counterclockwise (right
-                std::rotate(meterRectangles.rectangleStatus.rbegin(), meterRectangles.rectangleStatus.rbegin()+1, meterRectangles.rectangleStatus.rend()); //orig_first, new_first, orig_last
-            }
-            else if (cents > centTolerance)
-            {
-                //rotate clockwise (left)
-                std::rotate(meterRectangles.rectangleStatus.begin(), meterRectangles.rectangleStatus.begin()+1, meterRectangles.rectangleStatus.end()); //orig_first, new_first, orig_last
-            }
-        }
-        
-        strobeFrameCounter = ++strobeFrameCounter % numFramesUntilAdvance;
-    }
 }
 
 void SimpleTunerAudioProcessorEditor::resetMeterRectangleStatus()
 {
     for (int& status : meterRectangles.rectangleStatus) {status = 0;}
-        
-    if (meterMode == MeterMode::Strobe)
+}
+
+void SimpleTunerAudioProcessorEditor::setStrobeRunning(bool shouldRun)
+{
+    if (! shouldRun)
     {
-        meterRectangles.rectangleStatus.at(4) = 1;
-        meterRectangles.rectangleStatus.at(6) = 1;
+        strobeVBlankAttachment.reset();
+        return;
+    }
+    
+    if (strobeVBlankAttachment == nullptr)
+    {
+        //Start still, and take the first reading as it is
+        lastVBlankSeconds = juce::Time::getMillisecondCounterHiRes()*0.001;
+        strobeReadingVersion = 0;
+        strobeReadingSampleTime = -1;
+        strobeMidiNote = -1;
+        strobeHasNote = false;
+        strobeCents = strobeStartCents = strobeTargetCents = 0;
+        strobeRampSeconds = 0;
+        paintedStrobeOffset = -1;
+        strobeVBlankAttachment = std::make_unique<juce::VBlankAttachment>(this, [this] { updateStrobe(); });
     }
-    strobeFrameCounter = 0;
 }
 
-void SimpleTunerAudioProcessorEditor::drawTriangles(juce::Graphics& g)
+void SimpleTunerAudioProcessorEditor::updateStrobe()
 {
-    auto f_cents = noteData.cents;
+    const double now = juce::Time::getMillisecondCounterHiRes()*0.001;
+    const double elapsedSeconds = juce::jlimit(0.0, maxStrobeFrameSeconds, now - lastVBlankSeconds);
+    lastVBlankSeconds = now;
+    
+    //A new analysis reading. The cents ramp from where they are to it over the time the analysis took between the 2 readings
+    //(the hop), so they get there about when the next one comes in. A new note, a gap or silence jumps instead
+    juce::uint32 version;
+    const TunerReading reading = audioProcessor.getCurrentReading(0, &version);
+    if (version != strobeReadingVersion)
+    {
+        const double sampleRate = audioProcessor.getSampleRate();
+        const double secondsSinceLastReading = (sampleRate > 0) ? (reading.sampleTime - strobeReadingSampleTime)/sampleRate : 0.0;
+        const bool isSameNote = strobeHasNote && reading.hasPitch() && reading.midiNote == strobeMidiNote;
+        
+        strobeRampSeconds = (isSameNote && secondsSinceLastReading > 0 && secondsSinceLastReading <= maxStrobeRampSeconds) ? secondsSinceLastReading : 0.0;
+        strobeRampStartSeconds = now;
+        strobeStartCents = strobeCents;
+        strobeTargetCents = reading.hasPitch() ? reading.cents : 0.f;
+        strobeReadingVersion = version;
+        strobeReadingSampleTime = reading.sampleTime;
+        strobeMidiNote = reading.midiNote;
+        strobeHasNote = reading.hasPitch();
+    }
     
+    const double rampPosition = (strobeRampSeconds > 0) ? juce::jmin(1.0, (now - strobeRampStartSeconds)/strobeRampSeconds) : 1.0;
+    strobeCents = strobeStartCents + static_cast<float>(rampPosition)*(strobeTargetCents - strobeStartCents);
     
-    //Flat triangle
-    (f_cents < -centTolerance) ? g.setColour(juce::Colours::red) : g.setColour(juce::Colours::darkred);
-    g.fillPath(meterTriangles.triangles.at(0));
+    //Sharp slides left, flat slides right, like the old rotation. With no note the band stands still
+    if (strobeHasNote)
+    {
+        const double periodsPerSecond = strobeCents*strobeRectanglesPerSecondPerCent/2; //a period is 2 rectangles
+        strobePhase -= periodsPerSecond*elapsedSeconds;
+        strobePhase -= std::floor(strobePhase);
+    }
     
-    //Intune triangle
-    (f_cents < centTolerance && f_cents > -centTolerance && noteData.noteName != juce::String("")) ? g.setColour(juce::Colours::lightgreen) : g.setColour(juce::Colours::darkgreen);
-    g.fillPath(meterTriangles.triangles.at(1));
+    //Only repaint the band, and only when the bars moved by a quarter of a physical pixel (the antialiasing shows that much) or changed colour
+    const int offset = juce::roundToInt(4*strobePhase*getStrobePeriod()*juce::jmax(1.f, layerScale));
+    const bool inTune = strobeHasNote && std::abs(strobeCents) <= centTolerance;
+    if (offset != paintedStrobeOffset || inTune != paintedStrobeInTune)
+    {
+        paintedStrobeOffset = offset;
+        paintedStrobeInTune = inTune;
+        repaint(getStrobeBand());
+    }
+}
+
+void SimpleTunerAudioProcessorEditor::drawStrobe(juce::Graphics& g)
+{
+    //The dark band is in the background layer. The bars are at fractional positions, so even a sub-pixel step shows
+    //in their antialiased edges. At most width/period+2 bars, whatever the phase
+    const juce::Rectangle<float> band = getStrobeBand().toFloat();
+    const float period = getStrobePeriod();
+    if (period <= 0)
+    {
+        return;
+    }
     
-    //sharp triangle
-    (f_cents > centTolerance) ? g.setColour(juce::Colours::red) : g.setColour(juce::Colours::darkred);
-    g.fillPath(meterTriangles.triangles.at(2));
+    const bool inTune = strobeHasNote && std::abs(strobeCents) <= centTolerance;
+    g.setColour(inTune ? juce::Colours::lightgreen : juce::Colours::red);
+    for (float x = band.getX() + static_cast<float>(strobePhase)*period - period; x < band.getRight(); x += period)
+    {
+        g.fillRect(juce::Rectangle<float>(x, band.getY(), static_cast<float>(meterRectWidth), band.getHeight()).getIntersection(band));
+    }
+}
+
+std::array<bool, 3> SimpleTunerAudioProcessorEditor::getLitTriangles() const
+{
+    auto f_cents = tunerReading.cents;
+    return { f_cents < -centTolerance, //Flat triangle
+             f_cents < centTolerance && f_cents > -centTolerance && tunerReading.hasPitch(), //Intune triangle
+             f_cents > centTolerance }; //sharp triangle
+}
+
+void SimpleTunerAudioProcessorEditor::drawTriangles(juce::Graphics& g)
+{
+    //The unlit ones are already in the background layer
+    const std::array<bool, 3> litTriangles = getLitTriangles();
     
+    if (litTriangles[0])
+    {
+        g.setColour(juce::Colours::red);
+        g.fillPath(meterTriangles.triangles.at(0));
+    }
+    if (litTriangles[1])
+    {
+        g.setColour(juce::Colours::lightgreen);
+        g.fillPath(meterTriangles.triangles.at(1));
+    }
+    if (litTriangles[2])
+    {
+        g.setColour(juce::Colours::red);
+        g.fillPath(meterTriangles.triangles.at(2));
+    }
 }
 
 void SimpleTunerAudioProcessorEditor::initializeMeterRectangles()
@@ -311,38 +516,63 @@ void SimpleTunerAudioProcessorEditor::initializeModeButtons()
 {
     chromaticButton.setButtonText(std::string("Note"));
     strobeButton.setButtonText(std::string("Strobe"));
+    strumButton.setButtonText(std::string("Strum"));
     
     int areaBottom = buttonArea.getBottom();
     int rightEdge = buttonArea.getRight();
     
     modeButtonWidth = strobeButton.getBestWidthForHeight(modeButtonHeight);
         
-    chromaticButton.setBounds(rightEdge-(2*modeButtonWidth+2*modeButtonPaddingX), areaBottom-(modeButtonHeight+modeButtonPaddingY), modeButtonWidth, modeButtonHeight);
-    strobeButton.setBounds(rightEdge-(modeButtonWidth+modeButtonPaddingX), areaBottom-(modeButtonHeight+modeButtonPaddingY), modeButtonWidth, modeButtonHeight);
+    chromaticButton.setBounds(rightEdge-(3*modeButtonWidth+3*modeButtonPaddingX), areaBottom-(modeButtonHeight+modeButtonPaddingY), modeButtonWidth, modeButtonHeight);
+    strobeButton.setBounds(rightEdge-(2*modeButtonWidth+2*modeButtonPaddingX), areaBottom-(modeButtonHeight+modeButtonPaddingY), modeButtonWidth, modeButtonHeight);
+    strumButton.setBounds(rightEdge-(modeButtonWidth+modeButtonPaddingX), areaBottom-(modeButtonHeight+modeButtonPaddingY), modeButtonWidth, modeButtonHeight);
     
     chromaticButton.setTooltip("Switch to chromatic mode.");
     strobeButton.setTooltip("Switch to strobe mode.");
+    strumButton.setTooltip("Switch to strum mode: tune all the strings at once.");
     
     //We don't hard-code it because initialize gets called on resize and we want to keep the state
     chromaticButton.setToggleState(meterMode == MeterMode::Chromatic, juce::NotificationType::dontSendNotification); //Default to chromatic mode. 2nd arg is NotificationType notification
     strobeButton.setToggleState(meterMode == MeterMode::Strobe, juce::NotificationType::dontSendNotification);
+    strumButton.setToggleState(meterMode == MeterMode::Strum, juce::NotificationType::dontSendNotification);
 
     chromaticButton.onClick = [&]()
     {
         //we passed the capture by reference so our changes will be preserved outside the function
         strobeButton.setToggleState(false, juce::NotificationType::dontSendNotification);
+        strumButton.setToggleState(false, juce::NotificationType::dontSendNotification);
         chromaticButton.setToggleState(true, juce::NotificationType::dontSendNotification);
         meterMode = MeterMode::Chromatic;
+        audioProcessor.setPolyphonicMode(false);
+        setStrobeRunning(false);
         resetMeterRectangleStatus();
+        invalidateLayers(); //the unlit meter in the background layer depends on the mode
     };
     
     strobeButton.onClick = [&]()
     {
         //we passed the capture by reference so our changes will be preserved outside the function
         strobeButton.setToggleState(true, juce::NotificationType::dontSendNotification);
+        strumButton.setToggleState(false, juce::NotificationType::dontSendNotification);
         chromaticButton.setToggleState(false, juce::NotificationType::dontSendNotification);
         meterMode = MeterMode::Strobe;
+        audioProcessor.setPolyphonicMode(false);
+        setStrobeRunning(true);
         resetMeterRectangleStatus();
+        invalidateLayers(); //the unlit meter in the background layer depends on the mode
+    };
+    
+    strumButton.onClick = [&]()
+    {
+        strobeButton.setToggleState(false, juce::NotificationType::dontSendNotification);
+        strumButton.setToggleState(true, juce::NotificationType::dontSendNotification);
+        chromaticButton.setToggleState(false, juce::NotificationType::dontSendNotification);
+        meterMode = MeterMode::Strum;
+        audioProcessor.setPolyphonicMode(true);
+        setStrobeRunning(false);
+        m_numStrumNotes = 0; //don't show the last strum until there's a new one
+        updateMeterState();
+        invalidateLayers();
     };
     
 }
@@ -368,31 +598,45 @@ void SimpleTunerAudioProcessorEditor::initializeRefButtons()
     refMinusButton.setTooltip("Subtract 1 from reference frequency.");
     refPlusButton.setTooltip("Add 1 to reference frequency.");
     
+    //The reference lives in the processor's NoteMapper, so it's still there when the editor is opened again
     refMinusButton.onClick = [&]()
     {
-        //we passed the capture by reference so our changes will be preserved outside the function
-        if (referenceFrequency > 430.f)
+        NoteMapper noteMapper = audioProcessor.getNoteMapper();
+        if (noteMapper.getReferenceFrequency() > minReferenceFrequency)
         {
-        --referenceFrequency;
+            noteMapper.setReferenceFrequency(juce::jmax(minReferenceFrequency, noteMapper.getReferenceFrequency()-1));
+            audioProcessor.setNoteMapper(noteMapper); //the readings have the new cents from the next frame on
+            invalidateLayers(); //the reference text is in the background layer
         }
     };
     
     refPlusButton.onClick = [&]()
     {
-        if (referenceFrequency < 450.f)
+        NoteMapper noteMapper = audioProcessor.getNoteMapper();
+        if (noteMapper.getReferenceFrequency() < maxReferenceFrequency)
         {
-        ++referenceFrequency;
+            noteMapper.setReferenceFrequency(juce::jmin(maxReferenceFrequency, noteMapper.getReferenceFrequency()+1));
+            audioProcessor.setNoteMapper(noteMapper);
+            invalidateLayers();
         }
     };
 }
 
+juce::String SimpleTunerAudioProcessorEditor::getReferenceText() const
+{
+    //A whole number of Hz, with a decimal only if the reference was set to one (eg. 415.3)
+    const double reference = audioProcessor.getNoteMapper().getReferenceFrequency();
+    const int numDecimals = (reference == std::round(reference)) ? 0 : 1;
+    return juce::String("A: ")+juce::String(reference, numDecimals)+juce::String("Hz");
+}
+
 float SimpleTunerAudioProcessorEditor::getReferenceTextWidth(/*juce::Graphics& g*/)
 {
     float fontHeightArg = ( (float)strobeButton.getHeight()*0.6 > 14.f) ? 14.f : (float)strobeButton.getHeight()*0.6;
     
     const int fontHeight = juce::roundToInt(fontHeightArg);
     
-    juce::String refText = juce::String("A: ")+juce::String(referenceFrequency, 0)+juce::String("Hz");
+    juce::String refText = getReferenceText();
     juce::Font displayFont = juce::Font(fontHeight,juce::Font::plain);
 
     refTextArrangement.clear();
@@ -415,7 +659,7 @@ void SimpleTunerAudioProcessorEditor::drawReferenceText(juce::Graphics& g)
 
     
         
-    juce::String refText = juce::String("A: ")+juce::String(referenceFrequency, 0)+juce::String("Hz");
+    juce::String refText = getReferenceText();
     
     g.drawText(refText,
                buttonArea.getX()+refButtonWidth+2*modeButtonPaddingX, //X (topleft)
@@ -427,20 +671,27 @@ void SimpleTunerAudioProcessorEditor::drawReferenceText(juce::Graphics& g)
 }
 
 void SimpleTunerAudioProcessorEditor::drawNote(juce::Graphics& g)
+{
+    const int noteIndex = getDisplayedNoteIndex();
+    if (noteIndex >= 0)
+    {
+        g.drawImage(noteGlyphLayers[static_cast<size_t>(noteIndex)], noteArea.toFloat());
+    }
+}
+
+void SimpleTunerAudioProcessorEditor::drawNoteGlyph(juce::Graphics& g, int noteIndex)
 {
     g.setColour (juce::Colours::white);
     juce::Font displayFont = juce::Font(noteArea.getHeight(),juce::Font::bold);
-
-    tunerDisplay = noteData.noteName;
     
     int textBaseline = noteArea.getY()+noteDistanceFromRectangles+displayFont.getAscent(); //The ascent is the distance from the top to bottom of capital A
 
-    noteTextArrangement.clear();
-    noteTextArrangement.addJustifiedText(displayFont, tunerDisplay, noteArea.getX(), textBaseline, noteArea.getWidth(), juce::Justification::horizontallyCentred);
+    juce::GlyphArrangement noteTextArrangement; //basically a text field
+    noteTextArrangement.addJustifiedText(displayFont, noteLetters[static_cast<size_t>(noteIndex)], noteArea.getX(), textBaseline, noteArea.getWidth(), juce::Justification::horizontallyCentred);
     
-    noteLetterBoundingBox = noteTextArrangement.getBoundingBox(0, 1, false); //startIndex, numGlyphs, includeWhitespace
+    juce::Rectangle<float> noteLetterBoundingBox = noteTextArrangement.getBoundingBox(0, 1, false); //startIndex, numGlyphs, includeWhitespace
     
-    if (noteData.sharp)
+    if (NoteMapper::isSharp(noteIndex))
     {
         juce::Font sharpFont = juce::Font(noteArea.getHeight()/2,juce::Font::plain);
         int sharpXPos = noteLetterBoundingBox.getRight()+displayFont.getExtraKerningFactor();
@@ -448,16 +699,109 @@ void SimpleTunerAudioProcessorEditor::drawNote(juce::Graphics& g)
         noteTextArrangement.addLineOfText(sharpFont, "#", sharpXPos, sharpYPos);
     }
     
+    noteTextArrangement.draw(g);
+}
+
+void SimpleTunerAudioProcessorEditor::initializeStrumRows()
+{
+    //One row per string, lowest at the top: note name on the left, then a -50..+50 cents bar with a marker.
+    //Uses the space of the big meter (triangles, rectangles and note)
+    juce::Rectangle<int> meterArea = triangleArea.getUnion(rectangleArea).getUnion(noteArea);
+    const int numRows = SimpleTunerAudioProcessor::maxPolyphonicReadings;
+    const int rowHeight = meterArea.getHeight()/numRows;
+    const int rowPadding = static_cast<int>(rowHeight*strumRowPaddingScalar);
+    const int nameWidth = static_cast<int>(meterArea.getWidth()*strumNameWidthScalar);
+    
+    strumNameFont = juce::Font(rowHeight-2*rowPadding, juce::Font::bold);
     
-    if (tunerDisplay != juce::String(""))
+    for (size_t row = 0; row < strumRowAreas.size(); ++row)
     {
-        setMeterRectangleStatus(noteData.cents);
+        strumRowAreas[row] = meterArea.removeFromTop(rowHeight);
+        juce::Rectangle<int> rowArea = strumRowAreas[row].reduced(modeButtonPaddingX, rowPadding);
+        strumNameAreas[row] = rowArea.removeFromLeft(nameWidth);
+        strumBarAreas[row] = rowArea.reduced(modeButtonPaddingX, 0);
     }
-    else
+}
+
+void SimpleTunerAudioProcessorEditor::drawStrumBars(juce::Graphics& g)
+{
+    for (const auto& barArea : strumBarAreas)
     {
-        resetMeterRectangleStatus();
+        g.setColour(juce::Colours::darkgrey);
+        g.fillRect(barArea);
+        g.setColour(juce::Colours::white);
+        g.fillRect(barArea.getCentreX(), barArea.getY(), 1, barArea.getHeight()); //0 cents
     }
+}
+
+void SimpleTunerAudioProcessorEditor::drawStrumMeter(juce::Graphics& g)
+{
+    //The bars are in the background layer. updateMeterState already worked out the name and marker of every row
+    g.setFont(strumNameFont);
     
-    noteTextArrangement.draw(g);
-    
+    for (size_t row = 0; row < strumRows.size(); ++row)
+    {
+        const StrumRow& strumRow = strumRows[row];
+        const juce::Rectangle<int>& barArea = strumBarAreas[row];
+        
+        if (! strumRow.hasNote)
+        {
+            g.setColour(juce::Colours::white);
+            g.drawText(juce::String("-"), strumNameAreas[row], juce::Justification::centred);
+            continue;
+        }
+        
+        g.setColour(juce::Colours::white);
+        g.drawText(noteNames[static_cast<size_t>(strumRow.noteIndex)], strumNameAreas[row], juce::Justification::centred);
+        
+        const int markerWidth = juce::jmax(3, barArea.getWidth()/40);
+        strumRow.inTune ? g.setColour(juce::Colours::lightgreen) : g.setColour(juce::Colours::red);
+        g.fillRect(strumRow.markerX, barArea.getY(), markerWidth, barArea.getHeight());
+    }
+}
+
+juce::Rectangle<int> SimpleTunerAudioProcessorEditor::getDebugOverlayArea() const
+{
+    return getLocalBounds().removeFromTop(debugOverlayLineHeight*debugOverlayNumLines + modeButtonPaddingY);
+}
+
+void SimpleTunerAudioProcessorEditor::drawDebugOverlay(juce::Graphics& g)
+{
+    //A box in the top left corner with the instrumentation counters. Double click the editor to show/hide it
+    const auto& stats = instrumentationSnapshot;
+    
+    juce::StringArray lines;
+    lines.add("Blocks: " + juce::String(static_cast<int>(stats.numBlocks))
+              + "  avg " + juce::String(stats.getAverageBlockMicroseconds(), 1) + "us"
+              + "  p99 <" + juce::String(stats.getBlockMicrosecondsPercentile(0.99), 0) + "us"
+              + "  max " + juce::String(1.0e-3*stats.maxBlockNanoseconds, 1) + "us");
+    lines.add("FFTs: " + juce::String(static_cast<int>(stats.numFFTs))
+              + "  " + juce::String(stats.getAverageFFTsPerPass(), 2) + "/pass"
+              + "  tracker: " + juce::String(static_cast<int>(stats.numTrackerReadings))
+              + "  zoom: " + juce::String(static_cast<int>(stats.numZoomChecks))
+              + " (" + juce::String(static_cast<int>(stats.numZoomDisagreements)) + " disagreed)");
+    lines.add("Frames seen 2/1/0: " + juce::String(static_cast<int>(stats.viewTopAndNextOutcomes[2]))
+              + "/" + juce::String(static_cast<int>(stats.viewTopAndNextOutcomes[1]))
+              + "/" + juce::String(static_cast<int>(stats.viewTopAndNextOutcomes[0])));
+    lines.add("Dropped blocks: " + juce::String(static_cast<int>(stats.numDroppedBlocks))
+              + "  frames: " + juce::String(static_cast<int>(stats.numDroppedFrames)));
+    lines.add("Gaps: " + juce::String(static_cast<int>(stats.numGaps))
+              + "  discarded: " + juce::String(static_cast<int>(stats.numDiscardedSamples))
+              + "  coalesced: " + juce::String(static_cast<int>(stats.numCoalescedHops))
+              + "  skipped: " + juce::String(static_cast<int>(stats.numSkippedHops)));
+    
+    const int lineHeight = debugOverlayLineHeight;
+    jassert(lines.size() == debugOverlayNumLines);
+    juce::Rectangle<int> overlayArea = getDebugOverlayArea();
+    
+    g.setColour(juce::Colours::black.withAlpha(0.7f));
+    g.fillRect(overlayArea);
+    
+    g.setColour(juce::Colours::white);
+    g.setFont(juce::Font(lineHeight-2, juce::Font::plain));
+    overlayArea = overlayArea.reduced(modeButtonPaddingX, modeButtonPaddingY/2);
+    for (const auto& line : lines)
+    {
+        g.drawText(line, overlayArea.removeFromTop(lineHeight), juce::Justification::centredLeft);
+    }
 }
@@ -14,25 +14,6 @@
 //==============================================================================
 /**
 */
-struct NoteData
-{
-    NoteData (juce::String c_noteName, float c_cents, bool c_sharp=false)
-    {
-        noteName = c_noteName;
-        cents = c_cents;
-        sharp = c_sharp;
-    }
-    
-    NoteData()
-    {
-        noteName = juce::String("-");
-        cents = 0;
-    }
-    juce::String noteName;
-    float cents;
-    bool sharp;
-};
-
 struct MeterRectangles
 {
     std::vector< juce::Rectangle<int> > rectangles;
@@ -72,28 +53,52 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
     void timerCallback() override;
-    
-    
-    NoteData convertFreqToString(float freq, float refA4);
+    void mouseDoubleClick(const juce::MouseEvent&) override; //shows/hides the debug overlay
     
 
 
 private:
     void customizeLookAndFeel();
     
-    const int refreshRate = 12; //was 60fps. Now 12 to reduce flashing lights
+    const int refreshRate = 12; //was 60fps. Now 12 to reduce flashing lights. The strobe band has its own, the display's vblank
     float centTolerance = 1;
     
-    juce::String tunerDisplay {"Welcome!"};
-    
     //For the DSP
-    NoteData noteData;
+    TunerReading tunerReading; //the processor's snapshot of its newest reading, note and cents included
+    std::array<juce::String, 12> noteLetters, noteNames; //"C", "C", "D"... and "C", "C#", "D"..., made once so a reading never builds a string
     SimpleTunerAudioProcessor& audioProcessor;
     
     float m_currentExactF {0}, m_previousExactF {0}, m_freqToDisplay {0};
     
+    std::array<float, SimpleTunerAudioProcessor::maxPolyphonicReadings> m_strumFrequencies {}; //lowest first
+    int m_numStrumNotes {0};
+    
     void updateNoteData();
     
+    //Rendering. What only changes with the layout, the mode or the reference is drawn once into cached layers, and timerCallback
+    //only repaints the regions whose state changed since they were last painted. An unchanged reading doesn't repaint anything
+    juce::Image backgroundLayer; //background, the unlit meter (or the strum bars) and the reference text
+    std::array<juce::Image, 12> noteGlyphLayers; //noteArea sized, transparent, 1 per pitch class (letter + sharp)
+    float layerScale = 0; //physical pixels per logical pixel the layers were rendered at
+    void renderLayers(float scale);
+    void invalidateLayers(); //after a layout, mode or reference change. Repaints everything
+    
+    struct PaintedState
+    {
+        int noteIndex = -1;
+        std::vector<int> rectangleStatus;
+        std::array<bool, 3> litTriangles {};
+        juce::int64 numBlocksInOverlay = -1;
+    };
+    PaintedState paintedState; //what's on screen (or about to be)
+    void updateMeterState(); //what drawNote used to do to the rectangles, now once per tick instead of once per paint
+    void repaintChangedRegions();
+    void rememberPaintedState();
+    int getDisplayedNoteIndex() const { return tunerReading.hasPitch() ? tunerReading.noteIndex : -1; }
+    std::array<bool, 3> getLitTriangles() const;
+    juce::Colour getMeterRectangleColour(int index, bool isLit) const;
+    juce::Rectangle<int> getDebugOverlayArea() const;
+    
     //For the GUI
     float triangleHeightPercent = 0.25;
 
@@ -123,22 +128,77 @@ private:
     void initializeMeterTriangles();
     
     
-    juce::GlyphArrangement noteTextArrangement, refTextArrangement; //basically text fields
-    juce::Rectangle<float> noteLetterBoundingBox, refTextBoundingBox;
+    juce::GlyphArrangement refTextArrangement; //basically text fields
+    juce::Rectangle<float> refTextBoundingBox;
     void drawNote(juce::Graphics& g);
+    void drawNoteGlyph(juce::Graphics& g, int noteIndex); //into a noteGlyphLayer
     const int noteDistanceFromRectangles = 0;
     
+    //Strum mode: a row per note with a small cents bar instead of the big meter
+    void drawStrumMeter(juce::Graphics& g);
+    void drawStrumBars(juce::Graphics& g); //the unlit part, into the background layer
+    void initializeStrumRows();
+    float strumRowPaddingScalar = 0.15; //of a row's height
+    float strumNameWidthScalar = 0.2; //of the width
+    
+    struct StrumRow
+    {
+        bool hasNote = false;
+        int noteIndex = 0;
+        int markerX = 0;
+        bool inTune = false;
+        
+        bool operator!= (const StrumRow& other) const
+        {
+            return hasNote != other.hasNote || noteIndex != other.noteIndex || markerX != other.markerX || inTune != other.inTune;
+        }
+    };
+    std::array<StrumRow, SimpleTunerAudioProcessor::maxPolyphonicReadings> strumRows {}, paintedStrumRows {};
+    std::array<juce::Rectangle<int>, SimpleTunerAudioProcessor::maxPolyphonicReadings> strumRowAreas, strumNameAreas, strumBarAreas; //set in resized
+    juce::Font strumNameFont;
+    
     enum MeterMode{
         Chromatic,
-        Strobe
+        Strobe,
+        Strum
     };
     int meterMode = MeterMode::Chromatic;
-    int strobeFrameCounter;
     
-    float referenceFrequency = 440;
+    //Strobe mode: a band of bars that slides at a speed proportional to the cents off, like the disc of a strobe tuner.
+    //The position is a phase, integrated on every vblank of the display from the cents, and the cents are ramped from one
+    //analysis reading to the next over the time between them. So the motion is smooth at any frame rate, a fraction of a cent
+    //still moves (slowly), and the analysis rate doesn't have to go up for it
+    std::unique_ptr<juce::VBlankAttachment> strobeVBlankAttachment; //only while in strobe mode
+    void setStrobeRunning(bool shouldRun);
+    void updateStrobe(); //every vblank. A few multiplies and at most 1 repaint of the strobe band
+    void drawStrobe(juce::Graphics& g);
+    juce::Rectangle<int> getStrobeBand() const { return meterRectangles.rectangles.front().getUnion(meterRectangles.rectangles.back()); }
+    float getStrobePeriod() const { return 2.f*(meterRectWidth+meterRectSpacing); } //a lit bar and a gap, in pixels
+    static constexpr float strobeRectanglesPerSecondPerCent = 0.1f; //the old counter's speed: 10 cents = 1 rectangle a second
+    static constexpr double maxStrobeFrameSeconds = 0.1; //a stalled message thread doesn't make the band jump
+    static constexpr double maxStrobeRampSeconds = 0.25; //the longest hop is ~46 ms (8192/4 at 44.1k). More than this between readings was a gap, not a hop
+    
+    double strobePhase = 0; //in periods, 0..1
+    float strobeCents = 0, strobeStartCents = 0, strobeTargetCents = 0; //now, and the ramp between 2 readings
+    double strobeRampStartSeconds = 0, strobeRampSeconds = 0, lastVBlankSeconds = 0;
+    juce::uint32 strobeReadingVersion = 0; //of the processor's TunerReading
+    juce::int64 strobeReadingSampleTime = -1;
+    int strobeMidiNote = -1; //a new note jumps to its cents instead of ramping across the meter
+    bool strobeHasNote = false;
+    int paintedStrobeOffset = -1; //in quarters of a physical pixel
+    bool paintedStrobeInTune = false;
+    
+    //Debug overlay: what the analysis costs (AnalysisInstrumentation), refreshed with the display
+    bool showDebugOverlay = false;
+    AnalysisInstrumentation::Snapshot instrumentationSnapshot;
+    void drawDebugOverlay(juce::Graphics& g);
+    static constexpr int debugOverlayLineHeight = 14, debugOverlayNumLines = 5;
+    
+    static constexpr double minReferenceFrequency = 380, maxReferenceFrequency = 500; //what the +/- buttons can reach. The NoteMapper takes any reference
+    juce::String getReferenceText() const;
     void drawReferenceText(juce::Graphics& g);
     
-    juce::TextButton chromaticButton, strobeButton;
+    juce::TextButton chromaticButton, strobeButton, strumButton;
     void initializeModeButtons();
     int modeButtonWidth = 75; //pixels
     int modeButtonPaddingX = 10; //pixels
@@ -8,10 +8,11 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "SpectrumKernels.h"
 
 
 //==============================================================================
-SimpleTunerAudioProcessor::SimpleTunerAudioProcessor()
+SimpleTunerAudioProcessor::SimpleTunerAudioProcessor(int fftOrder)
 #ifndef JucePlugin_PreferredChannelConfigurations
      : AudioProcessor (BusesProperties()
                      #if ! JucePlugin_IsMidiEffect
@@ -20,13 +21,27 @@ SimpleTunerAudioProcessor::SimpleTunerAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::mono(), true)
                      #endif
-                       )
+                       ),
+#else
+     :
 #endif
+       masterFFTOrder(fftOrder)
 {
+    //Channel 0 always exists, the rest are added in prepareToPlay if the bus layout has them
+    channelAnalyses.push_back(std::make_unique<ChannelAnalysis>(*this, 0));
+    
+    TunerReading noReading;
+    noReading.fftOrder = masterFFTOrder;
+    for (auto& channelReading : channelReadings)
+    {
+        channelReading.write(noReading);
+    }
+    publishedNoteMapperSettings.write(noteMapper.getSettings());
 }
 
 SimpleTunerAudioProcessor::~SimpleTunerAudioProcessor()
 {
+    stopAnalysisThread();
 }
 
 //==============================================================================
@@ -97,23 +112,68 @@ void SimpleTunerAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     
-    //Initialize FIFO buffers.
-    bufferFifo.prepare(samplesPerBlock);
-    audioBufferForFFT.setSize(1,fftDataStructure.getFFTSize());
+    //The analysis thread reads everything below, so it has to be stopped while we set it up
+    stopAnalysisThread();
+    instrumentation.reset();
     
-    topFFTData.clear();
-    topFFTData.resize(masterFFTLength, 0);
-    nextFFTData.clear();
-    nextFFTData.resize(masterFFTLength,0);
+    //At high host rates the analysis runs on a decimated copy of the input, so the hop and everything after it is at analysisSampleRate
+    decimationFactor = decimation ? PolyphaseDecimator::chooseFactor(sampleRate) : 1;
+    analysisSampleRate = sampleRate/decimationFactor;
+    
+    //The hop is fixed per second of audio. The host's block size only decides how big the sample ring has to be
+    analysisHopSize = computeAnalysisHopSize(analysisSampleRate);
+    const int hostHopSize = analysisHopSize*decimationFactor;
+    
+    //One tuner per input channel. Channels are only ever added, so going back to fewer channels doesn't free anything on the next prepareToPlay
+    numAnalysisChannels = juce::jlimit(1, maxAnalysisChannels, getTotalNumInputChannels());
+    while (static_cast<int>(channelAnalyses.size()) < numAnalysisChannels)
+    {
+        channelAnalyses.push_back(std::make_unique<ChannelAnalysis>(*this, static_cast<int>(channelAnalyses.size())));
+    }
+    
+    //Initialize FIFO buffers.
+    if (lowMemoryMode)
+    {
+        bufferFifo.prepare(numAnalysisChannels, hostHopSize, samplesPerBlock, lowMemoryFifoCapacity);
+    }
+    else
+    {
+        bufferFifo.prepare(numAnalysisChannels, hostHopSize, samplesPerBlock);
+    }
+    overloadThreshold = juce::jmax(bufferFifo.getCapacity()/2, hostHopSize + samplesPerBlock); //the low memory ring is only about 2 blocks, so half of it is normal running
+    dummyBuffer.setSize(numAnalysisChannels, hostHopSize); //sized here so pulling from bufferFifo never allocates on the audio thread
+    decimatedBuffer.setSize(numAnalysisChannels, (decimationFactor > 1) ? analysisHopSize : 0);
+    prepareFFTScratch();
+    numSamplesAnalysed = 0;
+    skippingUntilCaughtUp = false;
     
-    currentExactF = -1.f;
+    //The estimator owns everything after the hop: history, FFTs, etc.
+    for (int channel = 0; channel < numAnalysisChannels; ++channel)
+    {
+        ChannelAnalysis& analysis = *channelAnalyses[static_cast<size_t>(channel)];
+        analysis.activeEstimator = getEstimator(analysis, estimatorType);
+        analysis.activeEstimator->prepare(analysisSampleRate, analysisHopSize);
+        analysis.decimator.prepare(sampleRate, decimationFactor);
+        
+        TunerReading noReading;
+        noReading.windowLength = analysis.activeEstimator->getWindowLength();
+        noReading.fftOrder = analysis.phaseVocoderEstimator.state.currentFFTOrder;
+        channelReadings[static_cast<size_t>(channel)].write(noReading);
+    }
+    numPublishedChannels = numAnalysisChannels;
+    numPolyphonicReadings = 0;
     
+    if (backgroundAnalysis)
+    {
+        startAnalysisThread(sampleRate, samplesPerBlock);
+    }
 }
 
 void SimpleTunerAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    stopAnalysisThread(); //joins the analysis thread (if there is one). prepareToPlay starts it again
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -124,11 +184,10 @@ bool SimpleTunerAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
     return true;
   #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Every input channel gets its own tuner, so anything from mono up to maxAnalysisChannels works
+    // (stereo for the hosts that only load stereo plug-ins, discrete layouts for a whole stage box).
+    const int numInputChannels = layouts.getMainInputChannelSet().size();
+    if (numInputChannels < 1 || numInputChannels > maxAnalysisChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -147,6 +206,7 @@ void SimpleTunerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     //processBlock doesn't fetch audio data. The audio data is already in the buffer object, which is an argument.
     
     juce::ScopedNoDenormals noDenormals; //does something to address floating point tomfoolery with large/small numbers
+    const auto startTicks = juce::Time::getHighResolutionTicks();
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -158,51 +218,810 @@ void SimpleTunerAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
 
     // This is the place where you'd normally do the guts of your plugin's
     // audio processing...
-    // Make sure to reset the state if your inner loop is processing
-    // the samples and the outer loop is handling the channels.
-    for (int channel = 0; channel < totalNumInputChannels; ++channel) //There should only be 1 channel
+    // There used to be a loop over the channels here, but every pass pushed channel 0 again.
+    // Now bufferFifo takes every input channel in one go and runAnalysis gives each one its own tuner.
+    const bool blockAccepted = bufferFifo.update(buffer); //Put the incoming audio into the sample FIFO
+    
+    if (analysisThread == nullptr)
     {
+        runAnalysis(); //Otherwise the analysis thread picks the samples up. All the audio thread does is the copy above
+    }
+    
+    const double elapsedSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    instrumentation.recordBlock(static_cast<juce::int64>(elapsedSeconds*1.0e9), blockAccepted);
+} //end processBlock()
 
-        bufferFifo.update(buffer); //Put the incoming audio into the sample FIFO
+void SimpleTunerAudioProcessor::runAnalysis()
+{
+    //Everything after the sample FIFO: every complete hop goes to the active estimator, and its readings are published.
+    //Runs on the audio thread, or on the analysis thread if backgroundAnalysis is on. Never on both at once
+    
+    int numHopsToCoalesce = 0;
+    while( bufferFifo.getNumCompleteBuffersAvailable() > 0)
+    {
+        //Checked every hop: a pass that can't keep up never runs out of hops, so it would never get to a check at the start
+        if (numHopsToCoalesce == 0 && ! skippingUntilCaughtUp && isOverloaded())
+        {
+            handleOverload(numHopsToCoalesce);
+        }
         
-        while( bufferFifo.getNumCompleteBuffersAvailable() > 0)
+        //dummyBuffer holds the buffer we just pulled from the FIFO
+        juce::int64 numSamplesLost;
+        if ( bufferFifo.getAudioBuffer(dummyBuffer, numSamplesLost) )
         {
-            //dummyBuffer holds the buffer we just pulled from the FIFO
-            if ( bufferFifo.getAudioBuffer(dummyBuffer) )
+            if (numSamplesLost > 0)
             {
-                int size = dummyBuffer.getNumSamples();
+                handleLostSamples(numSamplesLost); //a block was dropped somewhere in this hop
+            }
+            numSamplesAnalysed += dummyBuffer.getNumSamples();
+            updateAnalysisNoteMapper(); //a pass can be many hops when it's catching up
+            
+            //Behind: keep the history going, but no FFTs
+            bool skipThisHop = false;
+            if (numHopsToCoalesce > 0)
+            {
+                --numHopsToCoalesce;
+                skipThisHop = true;
+            }
+            else if (skippingUntilCaughtUp)
+            {
+                skippingUntilCaughtUp = bufferFifo.getNumCompleteBuffersAvailable() > 1; //the last 2 hops get analysed, 2 frames make a reading
+                skipThisHop = true;
+            }
+            if (skipThisHop)
+            {
+                instrumentation.recordSkippedHop(overloadPolicy == OverloadPolicy::coalesceToLatest);
+            }
+            
+            //Every channel gets the same hop, so the readings of all the channels line up in time
+            for (int channel = 0; channel < numAnalysisChannels; ++channel)
+            {
+                ChannelAnalysis& analysis = *channelAnalyses[static_cast<size_t>(channel)];
                 
+                //Skipped hops are decimated too, the filter's history has to keep going
+                const float* hopSamples = dummyBuffer.getReadPointer(channel);
+                int numHopSamples = dummyBuffer.getNumSamples();
+                if (decimationFactor > 1)
+                {
+                    numHopSamples = analysis.decimator.process(hopSamples, numHopSamples, decimatedBuffer.getWritePointer(channel));
+                    hopSamples = decimatedBuffer.getReadPointer(channel);
+                }
                 
-                //Shift the samples already in the audioBufferForFFT to the left to make room for dummyBuffer at the end
-                juce::FloatVectorOperations::copy(audioBufferForFFT.getWritePointer(0, 0), //float* dest
-                                                  audioBufferForFFT.getReadPointer(0,size),//const float* source
-                                                  audioBufferForFFT.getNumSamples()-size//int numValues
-                                                  );
-                //Now insert the dummyBuffer at the end
-                juce::FloatVectorOperations::copy(audioBufferForFFT.getWritePointer(0, audioBufferForFFT.getNumSamples()-size),
-                                                  dummyBuffer.getReadPointer(0,0),
-                                                  size);
+                if (skipThisHop)
+                {
+                    analysis.activeEstimator->skipHop(hopSamples, numHopSamples);
+                    continue;
+                }
                 
-                fftDataStructure.produceFFTData(audioBufferForFFT);
+                PitchReading reading;
+                if (analysis.activeEstimator->processHop(hopSamples, numHopSamples, numSamplesAnalysed, reading))
+                {
+                    publishReading(channel, reading);
+                }
+            }
+        }
+    }
+    
+    instrumentation.endAnalysisPass();
+}
+
+void SimpleTunerAudioProcessor::publishReading(int channel, const PitchReading& reading)
+{
+    const ChannelAnalysis& analysis = *channelAnalyses[static_cast<size_t>(channel)];
+    
+    TunerReading tunerReading;
+    tunerReading.frequency = reading.frequency;
+    tunerReading.peakMagnitude = reading.magnitude;
+    tunerReading.confidence = reading.confidence;
+    tunerReading.sampleTime = reading.sampleTime;
+    tunerReading.windowLength = analysis.activeEstimator->getWindowLength();
+    tunerReading.fftOrder = analysis.phaseVocoderEstimator.state.currentFFTOrder;
+    
+    const NoteReading note = analysisNoteMapper.map(reading.frequency); //not valid for silence/no reading
+    if (note.isValid)
+    {
+        tunerReading.noteIndex = note.noteIndex;
+        tunerReading.midiNote = note.midiNote;
+        tunerReading.cents = note.cents;
+    }
+    
+    channelReadings[static_cast<size_t>(channel)].write(tunerReading);
+}
+
+void SimpleTunerAudioProcessor::updateAnalysisNoteMapper()
+{
+    //1 atomic load when nothing changed. If the message thread is in the middle of a write, we try again on the next hop
+    if (publishedNoteMapperSettings.getVersion() != analysisNoteMapperVersion)
+    {
+        NoteMapper::Settings settings;
+        if (publishedNoteMapperSettings.tryRead(settings, &analysisNoteMapperVersion))
+        {
+            analysisNoteMapper.setSettings(settings); //numNotes exp2s, only when something changed
+        }
+    }
+}
+
+void SimpleTunerAudioProcessor::setNoteMapper(const NoteMapper& newNoteMapper)
+{
+    noteMapper = newNoteMapper;
+    publishedNoteMapperSettings.write(noteMapper.getSettings());
+}
+
+TunerReading SimpleTunerAudioProcessor::getCurrentReading(int channel, juce::uint32* version) const
+{
+    jassert(channel >= 0 && channel < maxAnalysisChannels);
+    return channelReadings[static_cast<size_t>(channel)].read(version);
+}
+
+bool SimpleTunerAudioProcessor::isOverloaded() const
+{
+    //In normal running there's at most a host block and a hop waiting. Half the ring means the analysis isn't keeping up
+    return bufferFifo.getNumSamplesAvailable() > overloadThreshold;
+}
+
+void SimpleTunerAudioProcessor::handleOverload(int& numHopsToCoalesce)
+{
+    const int numHopsWaiting = bufferFifo.getNumCompleteBuffersAvailable();
+    
+    switch (overloadPolicy.load())
+    {
+        case OverloadPolicy::dropOldest:
+        {
+            //Everything but the newest hops goes, without being copied. The estimators start again after the gap
+            const int numSamplesToDrop = bufferFifo.getNumSamplesAvailable() - hopsKeptOnOverload*bufferFifo.getSize();
+            juce::int64 numSamplesLost;
+            const int numSamplesDropped = bufferFifo.discardOldest(numSamplesToDrop, numSamplesLost);
+            if (numSamplesDropped > 0) //the low memory ring can be overloaded with fewer than hopsKeptOnOverload hops waiting, then nothing goes
+            {
+                instrumentation.recordDiscardedSamples(numSamplesDropped); //the producer's gaps in there are already counted by recordGap
+                handleLostSamples(numSamplesLost);
+            }
+            break;
+        }
+        case OverloadPolicy::coalesceToLatest:
+            numHopsToCoalesce = juce::jmax(0, numHopsWaiting - hopsKeptOnOverload); //never negative, runAnalysis only checks for overload at 0
+            break;
+        case OverloadPolicy::skipAnalysisUntilCaughtUp:
+            skippingUntilCaughtUp = true;
+            break;
+    }
+}
+
+void SimpleTunerAudioProcessor::handleLostSamples(juce::int64 numSamplesLost)
+{
+    //The sample clock jumps over the hole, so the reading times stay true. No window is allowed to reach back across it
+    numSamplesAnalysed += numSamplesLost;
+    instrumentation.recordGap();
+    
+    for (int channel = 0; channel < numAnalysisChannels; ++channel)
+    {
+        channelAnalyses[static_cast<size_t>(channel)]->activeEstimator->handleDiscontinuity();
+        channelAnalyses[static_cast<size_t>(channel)]->decimator.reset(); //don't filter across the hole either
+    }
+}
+
+void SimpleTunerAudioProcessor::prepareFFTAnalysis(FFTChannelState& channel, double sampleRate)
+{
+    //The FFT phase vocoder's part of prepareToPlay
+    if (! channel.fftStructuresBuilt || channel.usesFixedOrderFFT != fixedOrderFFT || channel.usesLowMemory != lowMemoryMode)
+    {
+        channel.buildFFTStructures(masterFFTOrder, fixedOrderFFT, lowMemoryMode);
+    }
+    
+    channel.audioBufferForFFT.setSize(1, masterFFTLength);
+    channel.audioBufferForFFT.clear();
+    channel.fftHistoryWritePosition = 0;
+    
+    for (auto& fftStructure : channel.fftStructures)
+    {
+        fftStructure->reset();
+    }
+    channel.previousFrame = {};
+    switchFFTOrder(channel, adaptiveFFTOrder ? static_cast<int>(FFTOrder::order2048) : masterFFTOrder); //start short: the first reading comes sooner
+    channel.samplesSinceDiscontinuity = std::numeric_limits<juce::int64>::max()/2; //the history starts silent, that's not a gap
+    trackerResyncIntervalHops = juce::jmax(1, juce::roundToInt(sampleRate/analysisHopSize));
+}
+
+bool SimpleTunerAudioProcessor::analyseHopWithFFT(FFTChannelState& channel, const float* samples, int numSamples, juce::int64 endSample, PitchReading& reading)
+{
+    //FFT the history after every hop, then a reading for every pair of FFT frames (or from the tracker while it's locked)
+    const bool findSeveralNotes = polyphonicMode && channel.channelIndex == 0 && ! channel.usesLowMemory; //strum mode only looks at the channel the editor shows, and needs whole frames
+    if ((! trackingMode || findSeveralNotes) && channel.peakTracker.isLocked())
+    {
+        channel.peakTracker.unlock();
+    }
+    
+    if (channel.peakTracker.isLocked())
+    {
+        slideTracker(channel, samples, numSamples); //needs the old samples, so before they're overwritten
+    }
+    
+    //audioBufferForFFT is circular: write the hop over the oldest samples instead of shifting everything to the left
+    writeToFFTHistory(channel, samples, numSamples);
+    
+    //The gap can be anywhere in the first hop after it, so that whole hop counts as old
+    channel.samplesSinceDiscontinuity += numSamples;
+    if (channel.samplesSinceDiscontinuity < channel.analysisFFTLength + analysisHopSize)
+    {
+        return false; //a phase difference across the gap would be wrong
+    }
+    
+    if (channel.peakTracker.isLocked())
+    {
+        if (produceTrackerReading(channel, endSample, reading))
+        {
+            instrumentation.recordTrackerReading();
+            return true; //no FFT needed for this hop
+        }
+        channel.peakTracker.unlock(); //lost it, this hop and the next ones get the full FFT
+    }
+    
+    bool newFFTReading = false;
+    if (channel.usesLowMemory)
+    {
+        newFFTReading = readLowMemoryFrame(channel, endSample, reading);
+    }
+    else
+    {
+        //fftHistoryWritePosition is now the oldest sample, which is where the FFT window starts
+        instrumentation.recordFFT(channel.activeFFTStructure->produceFFTData(channel.audioBufferForFFT, channel.fftHistoryWritePosition, endSample));
+    
+        //We need the numAvailableFFTDataBlocks to be at least 2 in order to use viewTopAndNext.
+        //We need both frames to calculate the phase remainder in findExactMaxFrequency. They're read in place, nothing is copied
+        while( channel.activeFFTStructure->getNumAvailableFFTDataBlocks() > 1) //was 0
+        {
+            const float* topFFTFrame;
+            const float* nextFFTFrame;
+            juce::int64 nextFrameEndSample;
+        
+            const int numFramesSeen = channel.activeFFTStructure->viewTopAndNext(topFFTFrame, nextFFTFrame, &nextFrameEndSample);
+            instrumentation.recordViewTopAndNext(numFramesSeen);
+        
+            if (numFramesSeen == 2)
+            {
+                reading.frequency = findExactMaxFrequency(channel, topFFTFrame, nextFFTFrame);
+                reading.magnitude = channel.peakMagnitude;
+                reading.sampleTime = nextFrameEndSample;
+                reading.confidence = getPhaseVocoderConfidence(channel, channel.lastPeakIndex/2, reading.frequency, reading.magnitude);
+                if (zoomCrossCheck && ! findSeveralNotes && nextFrameEndSample == endSample)
+                {
+                    crossCheckWithZoom(channel, reading); //only the newest frame's samples are still in the history
+                }
+                newFFTReading = true;
+            
+                if (findSeveralNotes)
+                {
+                    if (reading.frequency > 0.f)
+                    {
+                        findPolyphonicPeaks(channel, topFFTFrame, nextFFTFrame);
+                    }
+                    else
+                    {
+                        numPolyphonicReadings = 0; //below the noise threshold
+                    }
+                }
             }
+            channel.activeFFTStructure->finishedWithTopFrame(); //Discard the top frame, keep next for the next reading
+        }
+    }
+    
+    bool canLockTracker = newFFTReading && reading.frequency > 0.f;
+    
+    if (adaptiveFFTOrder && newFFTReading)
+    {
+        const int previousOrder = channel.currentFFTOrder;
+        updateAdaptiveFFTOrder(channel, reading.frequency);
+        canLockTracker = canLockTracker && (channel.currentFFTOrder == previousOrder); //after a switch there's no frame of the new order to track from yet
+    }
+    
+    //The newest frame is the current history, so a good reading from it is a safe place to start tracking
+    if (trackingMode && ! findSeveralNotes && canLockTracker)
+    {
+        lockTracker(channel);
+    }
+    
+    return newFFTReading;
+}
+
+void SimpleTunerAudioProcessor::findPolyphonicPeaks(FFTChannelState& channel, const float* topFrame, const float* nextFrame)
+{
+    //Several notes at once. 1 pass over the low part of the spectrum for local maxima, keeping the strongest maxPolyphonicCandidates,
+    //then each candidate is either a harmonic of a lower one or a new note. The work per frame is bounded by the bin range and the candidate count
+    const float binsPerHz = channel.analysisFFTLength/static_cast<float>(analysisSampleRate);
+    const int firstBin = juce::jmax(2, static_cast<int>(polyphonicMinFrequency*binsPerHz));
+    const int lastBin = juce::jmin(channel.analysisFFTLength/2 - 2, static_cast<int>(polyphonicMaxFrequency*binsPerHz));
+    
+    float* magnitudesSquared = magnitudesSquaredScratch.data();
+    const float maxSquared = SpectrumKernels::computeSquaredMagnitudes(topFrame, magnitudesSquared, lastBin+2);
+    const float thresholdSquared = juce::jmax(channel.fftThreshold*channel.fftThreshold, maxSquared*polyphonicRelativeThreshold*polyphonicRelativeThreshold);
+    
+    std::array<PolyphonicPeak, maxPolyphonicCandidates> candidates;
+    int numCandidates = 0;
+    
+    for (int bin = firstBin; bin <= lastBin; ++bin)
+    {
+        const float thisBin = magnitudesSquared[bin];
+        if (thisBin < thresholdSquared || thisBin <= magnitudesSquared[bin-1] || thisBin < magnitudesSquared[bin+1])
+        {
+            continue; //not a local max
         }
         
-        //Now at least 1 FFT vector exists in the fftDataStructure. We shall use this to findExactF
-        //We need the numAvailableFFTDataBlocks to be at least 2 in order to use pullTopViewNext.
-        //We need pullTopViewNext to calculate the phase remainder in findExactMaxFrequency
-        while( fftDataStructure.getNumAvailableFFTDataBlocks() > 1) //was 0
+        if (numCandidates < maxPolyphonicCandidates)
+        {
+            candidates[numCandidates++] = {bin, thisBin, 0.f, false};
+        }
+        else
         {
+            //Full: replace the weakest one if this is stronger (magnitude is still squared here)
+            auto weakest = std::min_element(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.magnitude < b.magnitude; });
+            if (weakest->magnitude < thisBin)
+            {
+                *weakest = {bin, thisBin, 0.f, false};
+            }
+        }
+    }
+    
+    auto candidatesEnd = candidates.begin()+numCandidates;
+    std::sort(candidates.begin(), candidatesEnd, [](const auto& a, const auto& b) { return a.bin < b.bin; }); //lowest first
+    
+    for (auto candidate = candidates.begin(); candidate != candidatesEnd; ++candidate)
+    {
+        //Exact frequency of every candidate with the same phase difference as findExactMaxFrequency
+        const int index = 2*candidate->bin;
+        candidate->magnitude = std::sqrt(candidate->magnitude);
+        candidate->frequency = phaseDifferenceToFrequency(channel, candidate->bin,
+                                                          std::atan2f(topFrame[index+1], topFrame[index]),
+                                                          std::atan2f(nextFrame[index+1], nextFrame[index]));
+    }
+    
+    //Harmonic grouping: going up, a candidate is a harmonic if it sits on a harmonic of any lower candidate (the lowest one wins).
+    //Harmonics of a string fall off smoothly, so if the candidate is much stronger than the last partial the lower one claimed,
+    //another string is playing on top of that harmonic (eg. the B string on the low E's 3rd harmonic) and it's a note of its own.
+    //Otherwise it's a new note. A note's strength is the sum of its partials, so a string with a weak fundamental but strong harmonics still counts.
+    //Lower candidates that are harmonics themselves still claim, eg. the 5th harmonic of a string whose fundamental was taken as another string's harmonic
+    std::array<PolyphonicPeak, maxPolyphonicCandidates> notes;
+    std::array<int, maxPolyphonicCandidates> noteOfCandidate; //-1 if the candidate is a harmonic
+    std::array<float, maxPolyphonicCandidates> lastPartialMagnitude; //of the highest partial each candidate has claimed so far, its own to start with
+    int numNotes = 0;
+    
+    for (int partial = 0; partial < numCandidates; ++partial)
+    {
+        for (int lower = 0; lower < partial; ++lower)
+        {
+            const int harmonicNumber = juce::roundToInt(candidates[partial].frequency/candidates[lower].frequency);
+            if (harmonicNumber < 2 || harmonicNumber > maxPolyphonicHarmonic)
+            {
+                continue;
+            }
             
-            int fftPullStatus = fftDataStructure.pullTopViewNext(topFFTData, nextFFTData);
-            if (fftPullStatus)
+            const float centsFromHarmonic = 1200.f*std::log2(candidates[partial].frequency/(harmonicNumber*candidates[lower].frequency));
+            if (std::abs(centsFromHarmonic) >= harmonicToleranceCents)
             {
-                currentExactF = findExactMaxFrequency(topFFTData, nextFFTData);
+                continue;
             }
+            
+            if (candidates[partial].magnitude <= lastPartialMagnitude[lower]*harmonicSmoothnessRatio)
+            {
+                candidates[partial].isHarmonic = true;
+                lastPartialMagnitude[lower] = candidates[partial].magnitude;
+                if (noteOfCandidate[lower] >= 0)
+                {
+                    notes[noteOfCandidate[lower]].magnitude += candidates[partial].magnitude;
+                }
+                break;
+            }
+        }
+        
+        noteOfCandidate[partial] = candidates[partial].isHarmonic ? -1 : numNotes;
+        lastPartialMagnitude[partial] = candidates[partial].magnitude;
+        if (! candidates[partial].isHarmonic)
+        {
+            notes[numNotes++] = candidates[partial];
+        }
+    }
+    
+    //Keep the strongest groups, then lowest note first so the rows line up with the strings
+    auto notesEnd = notes.begin()+numNotes;
+    if (numNotes > maxPolyphonicReadings)
+    {
+        std::partial_sort(notes.begin(), notes.begin()+maxPolyphonicReadings, notesEnd, [](const auto& a, const auto& b) { return a.magnitude > b.magnitude; });
+        numNotes = maxPolyphonicReadings;
+        notesEnd = notes.begin()+numNotes;
+    }
+    std::sort(notes.begin(), notesEnd, [](const auto& a, const auto& b) { return a.frequency < b.frequency; });
+    
+    for (int i = 0; i < numNotes; ++i)
+    {
+        polyphonicFrequencies[static_cast<size_t>(i)] = notes[static_cast<size_t>(i)].frequency;
+    }
+    numPolyphonicReadings = numNotes;
+}
+
+void SimpleTunerAudioProcessor::lockTracker(FFTChannelState& channel)
+{
+    channel.peakTracker.lock(channel.lastPeakIndex/2, channel.audioBufferForFFT.getReadPointer(0), channel.audioBufferForFFT.getNumSamples(), getFFTWindowStartIndex(channel));
+    channel.peakTracker.getWindowedBins(channel.trackerPreviousBins);
+    channel.trackerLockMagnitude = channel.peakMagnitude;
+    channel.hopsSinceLock = 0;
+    
+    //The FFT frames stop while we track, so the last one would be stale by the time we fall back
+    forgetFFTFrames(channel);
+}
+
+void SimpleTunerAudioProcessor::skipHopWithFFT(FFTChannelState& channel, const float* samples, int numSamples)
+{
+    //Overloaded: only the history is kept up to date. The tracker and the frames would be a hop stale after this
+    channel.peakTracker.unlock();
+    forgetFFTFrames(channel);
+    writeToFFTHistory(channel, samples, numSamples);
+    channel.samplesSinceDiscontinuity += numSamples;
+}
+
+void SimpleTunerAudioProcessor::handleFFTDiscontinuity(FFTChannelState& channel)
+{
+    //Both frames of a reading have to come from after the gap
+    channel.peakTracker.unlock();
+    forgetFFTFrames(channel);
+    channel.samplesSinceDiscontinuity = 0;
+}
+
+void SimpleTunerAudioProcessor::forgetFFTFrames(FFTChannelState& channel)
+{
+    if (channel.activeFFTStructure != nullptr)
+    {
+        channel.activeFFTStructure->reset();
+    }
+    channel.previousFrame.isValid = false;
+}
+
+bool SimpleTunerAudioProcessor::readLowMemoryFrame(FFTChannelState& channel, juce::int64 endSample, PitchReading& reading)
+{
+    //Low memory mode: 1 frame at a time in the shared workspace. The phase vocoder only needs the peak bin of the older frame
+    //(its index, magnitude and phase), so that's all we keep of it. The same readings as the frame pool to float rounding, without the frame pool
+    const int orderIndex = masterFFTOrder - channel.currentFFTOrder;
+    const int fftSize = channel.analysisFFTLength;
+    const int historySize = channel.audioBufferForFFT.getNumSamples();
+    const float* history = channel.audioBufferForFFT.getReadPointer(0);
+    const float* window = analysisWindows[static_cast<size_t>(orderIndex)]->data();
+    float* frame = lowMemoryFFTWorkspace.data();
+    
+    const int windowStartIndex = getFFTWindowStartIndex(channel);
+    const int numSamplesInFirstSegment = juce::jmin(fftSize, historySize-windowStartIndex);
+    juce::FloatVectorOperations::multiply(frame, history+windowStartIndex, window, numSamplesInFirstSegment);
+    if (numSamplesInFirstSegment < fftSize)
+    {
+        juce::FloatVectorOperations::multiply(frame+numSamplesInFirstSegment, history, window+numSamplesInFirstSegment, fftSize-numSamplesInFirstSegment);
+    }
+    
+    lowMemoryFFTPlans[static_cast<size_t>(orderIndex)]->performRealOnlyForwardTransform(frame);
+    instrumentation.recordFFT(true);
+    
+    bool newReading = false;
+    auto& previous = channel.previousFrame;
+    if (previous.isValid)
+    {
+        //What findExactMaxFrequency does with the top frame was done when it was the newest one
+        const int peakIndex = previous.peakIndex;
+        channel.lastPeakIndex = peakIndex;
+        channel.peakMagnitude = previous.peakMagnitude;
+        
+        reading.frequency = (previous.peakMagnitude < channel.fftThreshold) ? 0.f
+                            : phaseDifferenceToFrequency(channel, peakIndex/2, previous.peakPhase, std::atan2f(frame[peakIndex+1], frame[peakIndex]));
+        reading.magnitude = previous.peakMagnitude;
+        reading.sampleTime = endSample;
+        reading.confidence = getPhaseVocoderConfidence(channel, peakIndex/2, reading.frequency, reading.magnitude);
+        if (zoomCrossCheck)
+        {
+            crossCheckWithZoom(channel, reading);
         }
+        instrumentation.recordViewTopAndNext(2);
+        newReading = true;
+    }
+    
+    //This frame is the top frame of the next reading
+    const int maxIndex = findComplexMaxIndex(channel, frame);
+    previous.peakIndex = maxIndex;
+    previous.peakMagnitude = std::hypot(frame[maxIndex], frame[maxIndex+1]);
+    previous.peakPhase = std::atan2f(frame[maxIndex+1], frame[maxIndex]);
+    previous.isValid = true;
+    return newReading;
+}
 
+void SimpleTunerAudioProcessor::prepareFFTScratch()
+{
+    //Allocates, so only from prepareToPlay. Low memory mode trades the frame pools for 1 FFT workspace shared by every channel.
+    //The windows are shared tables (the frame generators hold the same ones), so every mode keeps them for the zoom
+    analysisWindows.clear();
+    for (int order = masterFFTOrder; order >= juce::jmin(static_cast<int>(FFTOrder::order2048), masterFFTOrder); --order)
+    {
+        analysisWindows.push_back(SharedFFTResources::getWindow(1 << order, SharedFFTResources::WindowType::blackmanHarris));
+    }
+    
+    if (lowMemoryMode)
+    {
+        lowMemoryFFTWorkspace.assign(static_cast<size_t>(masterFFTLength+2), 0.f); //the bins up to Nyquist, PackedRealFFT works in place
+        magnitudesSquaredScratch.clear(); //only strum mode needs it, and that's off in low memory mode
+        magnitudesSquaredScratch.shrink_to_fit();
         
-    } //end for channel loop
-} //end processBlock()
+        lowMemoryFFTPlans.clear();
+        for (int order = masterFFTOrder; order >= juce::jmin(static_cast<int>(FFTOrder::order2048), masterFFTOrder); --order)
+        {
+            lowMemoryFFTPlans.push_back(SharedFFTResources::getPackedRealFFT(order));
+        }
+    }
+    else
+    {
+        lowMemoryFFTWorkspace.clear();
+        lowMemoryFFTWorkspace.shrink_to_fit();
+        lowMemoryFFTPlans.clear();
+        magnitudesSquaredScratch.resize(static_cast<size_t>(masterFFTLength/2), 0.f); //1 value per bin for findPolyphonicPeaks
+    }
+}
+
+FFTFrameGenerator& SimpleTunerAudioProcessor::getFFTStructureForOrder(FFTChannelState& channel, int order)
+{
+    jassert(order <= masterFFTOrder && masterFFTOrder-order < static_cast<int>(channel.fftStructures.size()));
+    return *channel.fftStructures[channel.fftStructures.size()-1 - static_cast<size_t>(masterFFTOrder-order)];
+}
+
+int SimpleTunerAudioProcessor::getFFTWindowStartIndex(const FFTChannelState& channel) const
+{
+    //The active window is the newest analysisFFTLength samples of the history
+    const int historySize = channel.audioBufferForFFT.getNumSamples();
+    return (channel.fftHistoryWritePosition + historySize - channel.analysisFFTLength) % historySize;
+}
+
+void SimpleTunerAudioProcessor::switchFFTOrder(FFTChannelState& channel, int newOrder)
+{
+    //The history is shared, so nothing has to be refilled. The new order just needs 2 fresh frames before its first reading,
+    //and until then currentExactF keeps the last reading instead of showing anything wrong
+    if (! channel.fftStructures.empty()) //empty in low memory mode
+    {
+        channel.activeFFTStructure = &getFFTStructureForOrder(channel, newOrder);
+    }
+    forgetFFTFrames(channel); //anything left in there is from the last time we used this order
+    channel.analysisFFTLength = 1 << newOrder;
+    channel.fftThreshold = 0.001f*channel.analysisFFTLength;
+    channel.peakTracker.prepare(channel.analysisFFTLength); //also unlocks
+    channel.currentFFTOrder = newOrder;
+}
+
+void SimpleTunerAudioProcessor::updateAdaptiveFFTOrder(FFTChannelState& channel, float frequency)
+{
+    //The smallest order that puts the fundamental at least minFundamentalBin bins up. Silence goes back to the smallest order,
+    //so the next note gets its first reading as soon as possible
+    int wantedOrder = FFTOrder::order2048;
+    
+    if (frequency > 0.f)
+    {
+        const int order = channel.currentFFTOrder;
+        auto fundamentalBin = [&](int o) { return frequency*(1 << o)/static_cast<float>(analysisSampleRate); };
+        
+        while (wantedOrder < masterFFTOrder
+               && fundamentalBin(wantedOrder) < minFundamentalBin*(wantedOrder < order ? orderDownHysteresis : 1.f))
+        {
+            ++wantedOrder;
+        }
+    }
+    
+    if (wantedOrder != channel.currentFFTOrder)
+    {
+        switchFFTOrder(channel, wantedOrder);
+    }
+}
+
+void SimpleTunerAudioProcessor::slideTracker(FFTChannelState& channel, const float* samples, int numSamples)
+{
+    //The samples falling out of the window are the oldest ones of the active window, in at most 2 segments
+    const int historySize = channel.audioBufferForFFT.getNumSamples();
+    jassert(numSamples < channel.analysisFFTLength); //the hop is at most fftSize/4
+    
+    const float* history = channel.audioBufferForFFT.getReadPointer(0);
+    const int windowStartIndex = getFFTWindowStartIndex(channel);
+    const int numUntilEnd = juce::jmin(numSamples, historySize-windowStartIndex);
+    channel.peakTracker.processSamples(samples, history+windowStartIndex, numUntilEnd);
+    
+    if (numSamples > numUntilEnd) //wraparound
+    {
+        channel.peakTracker.processSamples(samples+numUntilEnd, history, numSamples-numUntilEnd);
+    }
+}
+
+bool SimpleTunerAudioProcessor::produceTrackerReading(FFTChannelState& channel, juce::int64 endSample, PitchReading& reading)
+{
+    //Same reading as findExactMaxFrequency, but from the tracked bins. Returns false if we should go back to the full FFT
+    std::array<float, SlidingDFTTracker::numTrackedBins*2> bins;
+    channel.peakTracker.getWindowedBins(bins);
+    
+    int peak = 0;
+    float peakMagnitudeSquared = -1.f;
+    for (int t = 0; t < SlidingDFTTracker::numTrackedBins; ++t)
+    {
+        const float magnitudeSquared = bins[2*t]*bins[2*t] + bins[2*t+1]*bins[2*t+1];
+        if (magnitudeSquared > peakMagnitudeSquared)
+        {
+            peakMagnitudeSquared = magnitudeSquared;
+            peak = t;
+        }
+    }
+    const float peakMagnitude = std::sqrt(peakMagnitudeSquared);
+    
+    if (++channel.hopsSinceLock >= trackerResyncIntervalHops //re-check the whole spectrum now and then, a louder note could have started elsewhere
+        || peak == 0 || peak == SlidingDFTTracker::numTrackedBins-1 //the energy is moving out of the tracked bins
+        || peakMagnitude < channel.fftThreshold
+        || peakMagnitude < channel.trackerLockMagnitude*trackerDropRatio)
+    {
+        return false;
+    }
+    
+    const int binNumber = channel.peakTracker.getCentreBin() - SlidingDFTTracker::centreIndex + peak;
+    const float topPhase = std::atan2f(channel.trackerPreviousBins[2*peak+1], channel.trackerPreviousBins[2*peak]);
+    const float nextPhase = std::atan2f(bins[2*peak+1], bins[2*peak]);
+    
+    reading.magnitude = peakMagnitude;
+    reading.frequency = phaseDifferenceToFrequency(channel, binNumber, topPhase, nextPhase);
+    reading.sampleTime = endSample;
+    reading.confidence = getPhaseVocoderConfidence(channel, binNumber, reading.frequency, reading.magnitude);
+    channel.trackerPreviousBins = bins;
+    return true;
+}
+
+void SimpleTunerAudioProcessor::setBackgroundAnalysis(bool shouldUseBackgroundThread)
+{
+    backgroundAnalysis = shouldUseBackgroundThread;
+}
+
+bool SimpleTunerAudioProcessor::isUsingBackgroundAnalysis() const
+{
+    return backgroundAnalysis;
+}
+
+void SimpleTunerAudioProcessor::setEstimatorType(EstimatorType newType)
+{
+    estimatorType = newType;
+}
+
+SimpleTunerAudioProcessor::EstimatorType SimpleTunerAudioProcessor::getEstimatorType() const
+{
+    return estimatorType;
+}
+
+juce::String SimpleTunerAudioProcessor::getEstimatorName() const
+{
+    return getEstimator(*channelAnalyses[0], estimatorType)->getName();
+}
+
+PitchEstimator* SimpleTunerAudioProcessor::getEstimator(ChannelAnalysis& analysis, EstimatorType type)
+{
+    switch (type)
+    {
+        case EstimatorType::mcLeodPitchMethod: return &analysis.mcLeodEstimator;
+        case EstimatorType::octavePyramid:     return &analysis.octavePyramidEstimator;
+        case EstimatorType::fftPhaseVocoder:
+        default:                               return &analysis.phaseVocoderEstimator;
+    }
+}
+
+int SimpleTunerAudioProcessor::getCurrentWindowLength(int channel) const
+{
+    return getCurrentReading(channel).windowLength;
+}
+
+void SimpleTunerAudioProcessor::setPolyphonicMode(bool shouldFindSeveralNotes)
+{
+    polyphonicMode = shouldFindSeveralNotes;
+    if (! shouldFindSeveralNotes)
+    {
+        numPolyphonicReadings = 0;
+    }
+}
+
+bool SimpleTunerAudioProcessor::isUsingPolyphonicMode() const
+{
+    return polyphonicMode;
+}
+
+int SimpleTunerAudioProcessor::getPolyphonicReadings(std::array<float, maxPolyphonicReadings>& frequencies) const
+{
+    //Not one atomic snapshot: a reading can be half old/half new for 1 display frame, which nobody will see
+    const int numReadings = numPolyphonicReadings;
+    for (int i = 0; i < numReadings; ++i)
+    {
+        frequencies[static_cast<size_t>(i)] = polyphonicFrequencies[static_cast<size_t>(i)];
+    }
+    return numReadings;
+}
+
+void SimpleTunerAudioProcessor::setAdaptiveFFTOrder(bool shouldAdaptFFTOrder)
+{
+    adaptiveFFTOrder = shouldAdaptFFTOrder;
+}
+
+bool SimpleTunerAudioProcessor::isUsingAdaptiveFFTOrder() const
+{
+    return adaptiveFFTOrder;
+}
+
+int SimpleTunerAudioProcessor::getCurrentFFTOrder(int channel) const
+{
+    return getCurrentReading(channel).fftOrder;
+}
+
+void SimpleTunerAudioProcessor::setTrackingMode(bool shouldTrackLockedPeak)
+{
+    trackingMode = shouldTrackLockedPeak;
+}
+
+bool SimpleTunerAudioProcessor::isUsingTrackingMode() const
+{
+    return trackingMode;
+}
+
+void SimpleTunerAudioProcessor::setZoomCrossCheck(bool shouldCrossCheckWithZoom)
+{
+    zoomCrossCheck = shouldCrossCheckWithZoom;
+}
+
+bool SimpleTunerAudioProcessor::isUsingZoomCrossCheck() const
+{
+    return zoomCrossCheck;
+}
+
+void SimpleTunerAudioProcessor::setAnalysisRate(double readingsPerSecond)
+{
+    jassert(readingsPerSecond > 0);
+    analysisRate = readingsPerSecond;
+    analysisOverlap = 0.f;
+}
+
+void SimpleTunerAudioProcessor::setAnalysisOverlap(float overlapFraction)
+{
+    jassert(overlapFraction > 0.f && overlapFraction < 1.f);
+    analysisOverlap = overlapFraction;
+}
+
+int SimpleTunerAudioProcessor::getAnalysisHopSize() const
+{
+    return analysisHopSize*decimationFactor;
+}
+
+juce::int64 SimpleTunerAudioProcessor::getCurrentReadingSampleTime(int channel)
+{
+    return getCurrentReading(channel).sampleTime;
+}
+
+int SimpleTunerAudioProcessor::computeAnalysisHopSize(double sampleRate) const
+{
+    const float overlap = analysisOverlap;
+    const double hop = (overlap > 0.f) ? masterFFTLength*(1.0-overlap)
+                                       : sampleRate/analysisRate;
+    
+    //The phase difference only unwraps correctly if the hop is small compared to the FFT.
+    //At fftLength/4 the estimator still covers +-2 bins around the peak, more than the harmonic checker can move it.
+    //In adaptive mode that has to hold for the shortest FFT too
+    const int shortestFFTLength = adaptiveFFTOrder ? (1 << FFTOrder::order2048) : masterFFTLength;
+    return juce::jlimit(minAnalysisHopSize, shortestFFTLength/4, juce::roundToInt(hop));
+}
+
+void SimpleTunerAudioProcessor::startAnalysisThread(double sampleRate, int samplesPerBlock)
+{
+    jassert(analysisThread == nullptr);
+    
+    //Poll about twice per host block. The audio thread never signals us, so it doesn't touch any locks
+    const int pollIntervalMs = juce::jmax(1, static_cast<int>(500.0*samplesPerBlock/sampleRate));
+    
+    analysisThread = std::make_unique<AnalysisThread>(*this, pollIntervalMs);
+    analysisThread->startThread();
+}
+
+void SimpleTunerAudioProcessor::stopAnalysisThread()
+{
+    if (analysisThread != nullptr)
+    {
+        analysisThread->stopThread(analysisThreadStopTimeoutMs); //signals the thread to exit and joins it
+        analysisThread.reset();
+    }
+}
 
 //==============================================================================
 bool SimpleTunerAudioProcessor::hasEditor() const
@@ -230,9 +1049,152 @@ void SimpleTunerAudioProcessor::setStateInformation (const void* data, int sizeI
 }
 
 
+//The public versions, on channel 0
+template<typename DataType>
+int SimpleTunerAudioProcessor::findComplexMaxIndex(const DataType* fftDataVector)
+{
+    return findComplexMaxIndex(getFirstFFTChannel(), fftDataVector);
+}
+
+template<typename DataType>
+int SimpleTunerAudioProcessor::findComplexMaxIndexReference(const DataType* fftDataVector)
+{
+    return findComplexMaxIndexReference(getFirstFFTChannel(), fftDataVector);
+}
+
+template<typename DataType>
+int SimpleTunerAudioProcessor::fundamentalFrequencyChecker(int i, float magI, const DataType* fftDataVector)
+{
+    return fundamentalFrequencyChecker(getFirstFFTChannel(), i, magI, fftDataVector);
+}
+
+float SimpleTunerAudioProcessor::findExactMaxFrequency(const float* fifoFFTData1, const float* fifoFFTData2)
+{
+    return findExactMaxFrequency(getFirstFFTChannel(), fifoFFTData1, fifoFFTData2);
+}
+
+float SimpleTunerAudioProcessor::phaseDifferenceToFrequency(int binNumber, float topPhase, float nextPhase)
+{
+    return phaseDifferenceToFrequency(getFirstFFTChannel(), binNumber, topPhase, nextPhase);
+}
+
 template<typename DataType>
-int SimpleTunerAudioProcessor::findComplexMaxIndex(std::vector<DataType>& fftDataVector)
+int SimpleTunerAudioProcessor::findComplexMaxIndex(FFTChannelState& channel, const DataType* fftDataVector)
 {
+    //Same result as findComplexMaxIndexReference, without a hypot per bin and without branching into the harmonic checker inside the loop.
+    //In the reference, maxIndex only keeps the result of the LAST new maximum, which is the first bin with the biggest magnitude,
+    //and that checker call gets the biggest magnitude BEFORE that bin. So we can find both with SIMD first and call the checker once.
+    static_assert(std::is_same_v<DataType, float>, "the SIMD kernels only handle float spectra");
+    
+    //The squared magnitudes are worked out a block of bins at a time on the stack, not kept for the whole spectrum (low memory mode
+    //has no room for that). 1 pass keeps the largest of each block, then only the blocks that can hold the peak are squared again
+    constexpr int binsPerBlock = 128;
+    constexpr int maxNumBlocks = 64;
+    const int numBins = channel.analysisFFTLength/2;
+    const int numBlocks = (numBins + binsPerBlock-1)/binsPerBlock;
+    jassert(numBlocks <= maxNumBlocks); //up to order14
+    
+    std::array<float, binsPerBlock> magnitudesSquared;
+    std::array<float, maxNumBlocks> blockMaxSquared;
+    
+    auto squareBlock = [&](int block, int endBin)
+    {
+        const int firstBin = block*binsPerBlock;
+        return SpectrumKernels::computeSquaredMagnitudes(fftDataVector + 2*firstBin, magnitudesSquared.data(), juce::jmin(binsPerBlock, endBin-firstBin));
+    };
+    
+    //1 pass: re^2+im^2 for every bin (SSE/AVX2/NEON) + the largest one
+    float maxSquared = 0.f;
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        blockMaxSquared[static_cast<size_t>(block)] = squareBlock(block, numBins);
+        maxSquared = juce::jmax(maxSquared, blockMaxSquared[static_cast<size_t>(block)]);
+    }
+    
+    if (maxSquared < 1.0e-30f)
+    {
+        //Silence or close to it. Squared values this small can flush to 0 and lose the ordering, so do it the slow way (the reading is below fftThreshold anyway)
+        return findComplexMaxIndexReference(channel, fftDataVector);
+    }
+    
+    //The squared values are rounded differently than hypot, so the ordering could differ for near-ties.
+    //Any bin within this tolerance of the max is re-checked with hypot, exactly like the reference. There's usually only 1.
+    constexpr float nearTieTolerance = 1.0e-5f;
+    
+    auto findFirstLargestWithHypot = [&](int endBin, float maxSquaredInRange, float& largestMagnitude)
+    {
+        const float threshold = maxSquaredInRange*(1.f-nearTieTolerance);
+        int largestBin = 0;
+        largestMagnitude = -1.f;
+        
+        for (int block = 0; block*binsPerBlock < endBin; ++block)
+        {
+            if (blockMaxSquared[static_cast<size_t>(block)] < threshold)
+            {
+                continue; //nothing close to the max in here
+            }
+            
+            const int firstBin = block*binsPerBlock;
+            const int numBinsInBlock = juce::jmin(binsPerBlock, endBin-firstBin);
+            squareBlock(block, endBin);
+            for (int bin = SpectrumKernels::findFirstAtLeast(magnitudesSquared.data(), 0, numBinsInBlock, threshold);
+                 bin < numBinsInBlock;
+                 bin = SpectrumKernels::findFirstAtLeast(magnitudesSquared.data(), bin+1, numBinsInBlock, threshold))
+            {
+                const float magnitude = std::hypot(fftDataVector[2*(firstBin+bin)], fftDataVector[2*(firstBin+bin)+1]);
+                if (largestMagnitude < magnitude) //strictly bigger, so the first one wins a tie like in the reference
+                {
+                    largestMagnitude = magnitude;
+                    largestBin = firstBin+bin;
+                }
+            }
+        }
+        return largestBin;
+    };
+    
+    float peakMagnitude;
+    const int peakBin = findFirstLargestWithHypot(numBins, maxSquared, peakMagnitude);
+    
+    if (peakBin == 0)
+    {
+        return 0; //DC is the biggest. The reference never calls the checker in this case
+    }
+    
+    //The biggest magnitude before the peak, which is what the reference passes to the checker as maxElement.
+    //The whole blocks before the peak's block already have their largest, the peak's block is squared again up to the peak
+    const int peakBlock = peakBin/binsPerBlock;
+    float previousMaxSquared = 0.f;
+    for (int block = 0; block < peakBlock; ++block)
+    {
+        previousMaxSquared = juce::jmax(previousMaxSquared, blockMaxSquared[static_cast<size_t>(block)]);
+    }
+    if (peakBin > peakBlock*binsPerBlock)
+    {
+        blockMaxSquared[static_cast<size_t>(peakBlock)] = squareBlock(peakBlock, peakBin); //now only the bins before the peak, for the search below
+        previousMaxSquared = juce::jmax(previousMaxSquared, blockMaxSquared[static_cast<size_t>(peakBlock)]);
+    }
+    
+    float previousMaxMagnitude;
+    if (previousMaxSquared < 1.0e-30f)
+    {
+        previousMaxMagnitude = std::hypot(fftDataVector[0], fftDataVector[1]); //the squares flushed to 0, so do it with hypot like the reference
+        for (int bin = 1; bin < peakBin; ++bin)
+        {
+            previousMaxMagnitude = std::max(previousMaxMagnitude, std::hypot(fftDataVector[2*bin], fftDataVector[2*bin+1]));
+        }
+    }
+    else
+    {
+        findFirstLargestWithHypot(peakBin, previousMaxSquared, previousMaxMagnitude);
+    }
+    
+    return fundamentalFrequencyChecker(channel, 2*peakBin, previousMaxMagnitude, fftDataVector); //This is the index WHERE THE DATA IS. If we want the "structural" index, that would be maxIndex/2
+}
+
+template<typename DataType>
+int SimpleTunerAudioProcessor::findComplexMaxIndexReference(FFTChannelState& channel, const DataType* fftDataVector)
+{
+    //The original hypot-per-bin search. findComplexMaxIndex has to return exactly what this returns
     int maxIndex = 0;
     //basically the same as hypot
 //    DataType maxElement = fftDataVector[maxIndex]*fftDataVector[maxIndex] + fftDataVector[maxIndex+1]*fftDataVector[maxIndex+1]; //pow(fftDV[0],2)+pow(fftDV[1],2)
@@ -243,7 +1205,7 @@ int SimpleTunerAudioProcessor::findComplexMaxIndex(std::vector<DataType>& fftDat
     
     DataType thisElement {};
     
-    for (int i = 2; i < masterFFTLength; i = i+2) //index 1 is imag(DC)
+    for (int i = 2; i < channel.analysisFFTLength; i = i+2) //index 1 is imag(DC)
     {
 
         
@@ -251,7 +1213,7 @@ int SimpleTunerAudioProcessor::findComplexMaxIndex(std::vector<DataType>& fftDat
         
         if (maxElement < thisElement)
         {
-            maxIndex = fundamentalFrequencyChecker(i, maxElement, fftDataVector); //i;
+            maxIndex = fundamentalFrequencyChecker(channel, i, maxElement, fftDataVector); //i;
             maxElement = thisElement;
             
         }//end if
@@ -261,7 +1223,7 @@ int SimpleTunerAudioProcessor::findComplexMaxIndex(std::vector<DataType>& fftDat
 }
 
 template<typename DataType>
-int SimpleTunerAudioProcessor::fundamentalFrequencyChecker(int i, float magI, std::vector<DataType>& fftDataVector)
+int SimpleTunerAudioProcessor::fundamentalFrequencyChecker(FFTChannelState& channel, int i, float magI, const DataType* fftDataVector)
 {
     //Previously there was a bug where the tuner would report an incorrect note
     //if a harmonic is higher power than the fundamental
@@ -276,13 +1238,13 @@ int SimpleTunerAudioProcessor::fundamentalFrequencyChecker(int i, float magI, st
     int indexToReturn = i, tempIndexHolder;
     float largestMag = magI;
     
-    tempIndexHolder = checkSpecificHarmonic(3, i, largestMag, fftDataVector);
+    tempIndexHolder = checkSpecificHarmonic(channel, 3, i, largestMag, fftDataVector);
     indexToReturn = (tempIndexHolder < indexToReturn) ? tempIndexHolder : indexToReturn; //If we find a local max at the LOWER index, replace it
     
-    tempIndexHolder = checkSpecificHarmonic(5, i, largestMag, fftDataVector);
+    tempIndexHolder = checkSpecificHarmonic(channel, 5, i, largestMag, fftDataVector);
     indexToReturn = (tempIndexHolder < indexToReturn) ? tempIndexHolder : indexToReturn; //If we find a local max at the LOWER index, replace it
     
-    tempIndexHolder = checkSpecificHarmonic(6, i, largestMag, fftDataVector);
+    tempIndexHolder = checkSpecificHarmonic(channel, 6, i, largestMag, fftDataVector);
     indexToReturn = (tempIndexHolder < indexToReturn) ? tempIndexHolder : indexToReturn; //If we find a local max at the LOWER index, replace it
 
     //static int counter = 0;
@@ -292,12 +1254,12 @@ int SimpleTunerAudioProcessor::fundamentalFrequencyChecker(int i, float magI, st
 }
 
 template<typename DataType>
-int SimpleTunerAudioProcessor::checkSpecificHarmonic(int harmonicNumber, int i, float& magI, std::vector<DataType>& fftDataVector)
+int SimpleTunerAudioProcessor::checkSpecificHarmonic(FFTChannelState& channel, int harmonicNumber, int i, float& magI, const DataType* fftDataVector)
 {
-    //magI is a reference to avoid making destructor calls
+    //magI is a reference to avoid making destructor calls. Plain locals: several processors (batch jobs, instances) run this at once
     
-    static int rootIndex1, rootIndex2;
-    static float fftMag1, fftMag2, fftMagMin1, fftMagPlus1;
+    int rootIndex1 = 0, rootIndex2 = 0;
+    float fftMag1 = 0, fftMag2 = 0, fftMagMin1 = 0, fftMagPlus1 = 0;
     
     if ( (i) % (2*harmonicNumber) == 0 )
     {
@@ -325,7 +1287,7 @@ int SimpleTunerAudioProcessor::checkSpecificHarmonic(int harmonicNumber, int i,
         fftMag1 = hypotf(fftDataVector[0], fftDataVector[1]);
         fftMagPlus1 = hypotf(fftDataVector[2], fftDataVector[3]);
         
-        if (fftMag1 > magI && (getSampleRate()/masterFFTLength > 20.f) ) {  i = 0; } //non-audible fundamentals should not be reported
+        if (fftMag1 > magI && (analysisSampleRate/channel.analysisFFTLength > 20.f) ) {  i = 0; } //non-audible fundamentals should not be reported
         if (fftMagPlus1 > magI) { i = 2; magI = fftMagPlus1; }
         
     }
@@ -363,15 +1325,41 @@ int SimpleTunerAudioProcessor::checkSpecificHarmonic(int harmonicNumber, int i,
     return i;
 }
 
-float SimpleTunerAudioProcessor::findExactMaxFrequency(std::vector<float>& fifoFFTData1, std::vector<float>& fifoFFTData2)
+void SimpleTunerAudioProcessor::writeToFFTHistory(FFTChannelState& channel, const float* samples, int numSamples)
 {
-    //At this point we already took the FFT. Data1 is the current FFT data, Data2 is the previous FFT data. We need both in order to find the phase remainder of the current FFT data
+    //Copies into the circular audioBufferForFFT in at most 2 segments. O(numSamples) instead of O(fftSize) per hop
+    const int historySize = channel.audioBufferForFFT.getNumSamples();
+    
+    if (numSamples >= historySize)
+    {
+        //The block is longer than the whole window, only the newest historySize samples matter
+        juce::FloatVectorOperations::copy(channel.audioBufferForFFT.getWritePointer(0), samples+(numSamples-historySize), historySize);
+        channel.fftHistoryWritePosition = 0;
+        return;
+    }
+    
+    const int numUntilEnd = juce::jmin(numSamples, historySize-channel.fftHistoryWritePosition);
+    juce::FloatVectorOperations::copy(channel.audioBufferForFFT.getWritePointer(0, channel.fftHistoryWritePosition), samples, numUntilEnd);
+    
+    if (numSamples > numUntilEnd) //wraparound
+    {
+        juce::FloatVectorOperations::copy(channel.audioBufferForFFT.getWritePointer(0), samples+numUntilEnd, numSamples-numUntilEnd);
+    }
     
-    int maxIndex = findComplexMaxIndex(fifoFFTData1);
+    channel.fftHistoryWritePosition = (channel.fftHistoryWritePosition+numSamples) % historySize;
+}
+
+float SimpleTunerAudioProcessor::findExactMaxFrequency(FFTChannelState& channel, const float* fifoFFTData1, const float* fifoFFTData2)
+{
+    //At this point we already took the FFT. Data1 is the current FFT data, Data2 is the previous FFT data. We need both in order to find the phase remainder of the current FFT data
     
+    int maxIndex = findComplexMaxIndex(channel, fifoFFTData1);
+    channel.lastPeakIndex = maxIndex;
     
+    float peakMagnitude = std::hypot(fifoFFTData1[maxIndex], fifoFFTData1[maxIndex+1]);
+    channel.peakMagnitude = peakMagnitude;
     
-    if ( std::hypot(fifoFFTData1[maxIndex], fifoFFTData1[maxIndex+1]) < fftThreshold)
+    if ( peakMagnitude < channel.fftThreshold)
     {
         //If the magnitude @ maxIndex is below the noise threshold
         return 0.0f;
@@ -380,24 +1368,148 @@ float SimpleTunerAudioProcessor::findExactMaxFrequency(std::vector<float>& fifoF
     float topPhase = std::atan2f(fifoFFTData1[maxIndex+1], fifoFFTData1[maxIndex]); //atan2(imag, real)
     float nextPhase = std::atan2f(fifoFFTData2[maxIndex+1], fifoFFTData2[maxIndex]);
     
-   
+    return phaseDifferenceToFrequency(channel, maxIndex/2, topPhase, nextPhase);
+    
+}
+
+void SimpleTunerAudioProcessor::crossCheckWithZoom(FFTChannelState& channel, PitchReading& reading)
+{
+    //Zoom into the newest frame's spectrum around the FFT's peak bin. A steady note gives the same frequency both ways, to a few
+    //hundredths of a cent. The phase difference's is kept either way (it's as close or closer, and a bit less noisy), the zoom only
+    //says how much to believe it. When they disagree (the note is changing, noise, or another partial leaks into the peak's bins,
+    //eg. a low E in a 2048 window) the confidence is cut in proportion, so 10x zoomAgreementCents apart is a tenth of it
+    if (! (reading.frequency > 0.f))
+    {
+        return; //below the noise threshold
+    }
+    
+    const int fftSize = channel.analysisFFTLength;
+    const float* window = analysisWindows[static_cast<size_t>(masterFFTOrder - channel.currentFFTOrder)]->data();
+    const double peakBin = ZoomTransform::findPeakBin(channel.audioBufferForFFT.getReadPointer(0), channel.audioBufferForFFT.getNumSamples(),
+                                                      getFFTWindowStartIndex(channel), window, fftSize, channel.lastPeakIndex/2);
+    const float zoomedFrequency = static_cast<float>(analysisSampleRate*peakBin/fftSize);
     
-    float phaseRemainder = (nextPhase-topPhase) - dummyBuffer.getNumSamples()*juce::MathConstants<float>::twoPi*(maxIndex/2)/masterFFTLength;
+    const float centsApart = (zoomedFrequency > 0.f) ? std::abs(1200.f*std::log2(zoomedFrequency/reading.frequency)) : 1200.f;
+    const bool agrees = centsApart < zoomAgreementCents;
+    instrumentation.recordZoomCheck(agrees);
+    if (! agrees)
+    {
+        reading.confidence *= zoomAgreementCents/centsApart;
+    }
+}
+
+float SimpleTunerAudioProcessor::phaseDifferenceToFrequency(FFTChannelState& channel, int binNumber, float topPhase, float nextPhase)
+{
+    //The two frames are analysisHopSize samples apart, whatever block size the host used
+    float phaseRemainder = (nextPhase-topPhase) - analysisHopSize*juce::MathConstants<float>::twoPi*binNumber/channel.analysisFFTLength;
     phaseRemainder = std::remainder(phaseRemainder, juce::MathConstants<float>::twoPi); //angle wrap from -pi to pi
    
     
-    float exactOmega = phaseRemainder/dummyBuffer.getNumSamples() + juce::MathConstants<float>::twoPi*(maxIndex/2)/masterFFTLength;
+    float exactOmega = phaseRemainder/analysisHopSize + juce::MathConstants<float>::twoPi*binNumber/channel.analysisFFTLength;
+
+    
+    return ( analysisSampleRate*exactOmega/juce::MathConstants<float>::twoPi );
+}
+
+float SimpleTunerAudioProcessor::getCurrentExactF(int channel)
+{
+    return getCurrentReading(channel).frequency;
+}
+
+float SimpleTunerAudioProcessor::getCurrentPeakMagnitude(int channel)
+{
+    return getCurrentReading(channel).peakMagnitude;
+}
 
+float SimpleTunerAudioProcessor::getPhaseVocoderConfidence(const FFTChannelState& channel, int binNumber, float frequency, float magnitude) const
+{
+    if (! (frequency > 0.f))
+    {
+        return 0.f;
+    }
     
-    return ( getSampleRate()*exactOmega/juce::MathConstants<float>::twoPi );
+    const float decibelsAboveThreshold = juce::Decibels::gainToDecibels(magnitude/channel.fftThreshold);
+    const float levelConfidence = juce::jlimit(0.f, 1.f, decibelsAboveThreshold/fullConfidenceDecibelsAboveThreshold);
     
+    //1 up to half a bin from the peak bin, down to 0 a whole bin away
+    const float binOffset = std::abs(frequency*channel.analysisFFTLength/static_cast<float>(analysisSampleRate) - binNumber);
+    const float binConfidence = juce::jlimit(0.f, 1.f, 2.f*(1.f - binOffset));
+    
+    return levelConfidence*binConfidence;
+}
+
+int SimpleTunerAudioProcessor::getNumAnalysisChannels() const
+{
+    return numPublishedChannels;
+}
+
+void SimpleTunerAudioProcessor::setFixedOrderFFT(bool shouldUseFixedOrderFFT)
+{
+    fixedOrderFFT = shouldUseFixedOrderFFT;
 }
 
-float SimpleTunerAudioProcessor::getCurrentExactF()
+bool SimpleTunerAudioProcessor::isUsingFixedOrderFFT() const
 {
-    return currentExactF;
+    return fixedOrderFFT;
 }
 
+void SimpleTunerAudioProcessor::setLowMemoryMode(bool shouldUseLowMemory)
+{
+    lowMemoryMode = shouldUseLowMemory;
+}
+
+bool SimpleTunerAudioProcessor::isUsingLowMemoryMode() const
+{
+    return lowMemoryMode;
+}
+
+void SimpleTunerAudioProcessor::setDecimation(bool shouldDecimate)
+{
+    decimation = shouldDecimate;
+}
+
+bool SimpleTunerAudioProcessor::isUsingDecimation() const
+{
+    return decimation;
+}
+
+SimpleTunerAudioProcessor::MemoryFootprint SimpleTunerAudioProcessor::getMemoryFootprint() const
+{
+    MemoryFootprint footprint;
+    footprint.processorObjects = sizeof(*this) + channelAnalyses.size()*sizeof(ChannelAnalysis);
+    footprint.sampleFifo = bufferFifo.getMemoryBytes() + static_cast<size_t>(dummyBuffer.getNumChannels()*dummyBuffer.getNumSamples()
+                                                                             + decimatedBuffer.getNumChannels()*decimatedBuffer.getNumSamples())*sizeof(float);
+    
+    for (const auto& analysis : channelAnalyses)
+    {
+        footprint.estimators += analysis->phaseVocoderEstimator.getMemoryBytes() + analysis->mcLeodEstimator.getMemoryBytes()
+                                + analysis->octavePyramidEstimator.getMemoryBytes() + analysis->decimator.getMemoryBytes();
+    }
+    
+    footprint.scratch = (magnitudesSquaredScratch.capacity() + lowMemoryFFTWorkspace.capacity())*sizeof(float);
+    return footprint;
+}
+
+void SimpleTunerAudioProcessor::setOverloadPolicy(OverloadPolicy newPolicy)
+{
+    overloadPolicy = newPolicy;
+}
+
+SimpleTunerAudioProcessor::OverloadPolicy SimpleTunerAudioProcessor::getOverloadPolicy() const
+{
+    return overloadPolicy;
+}
+
+AnalysisInstrumentation::Snapshot SimpleTunerAudioProcessor::getInstrumentationSnapshot() const
+{
+    return instrumentation.getSnapshot();
+}
+
+//The analysis templates are defined in this file, so instantiate the ones the tools outside of this file use
+template int SimpleTunerAudioProcessor::findComplexMaxIndex<float>(const float*);
+template int SimpleTunerAudioProcessor::findComplexMaxIndexReference<float>(const float*);
+template int SimpleTunerAudioProcessor::fundamentalFrequencyChecker<float>(int, float, const float*);
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -10,215 +10,263 @@
 
 #include <JuceHeader.h>
 #include <array>
+#include "SlidingDFTTracker.h"
+#include "McLeodPitchEstimator.h"
+#include "OctavePyramidEstimator.h"
+#include "AnalysisInstrumentation.h"
+#include "FFTFrameGenerator.h"
+#include "SharedFFTResources.h"
+#include "NoteMapper.h"
+#include "TunerReading.h"
+#include "PolyphaseDecimator.h"
+#include "ZoomTransform.h"
 
 //==============================================================================
 
 /*
+ * CHANNELS: every input channel (up to maxAnalysisChannels) is its own tuner. They share the sample FIFO and the hop timing,
+ * and each one has its own estimator and history and publishes its own reading. Channel 0 is the one the editor shows.
+ *
+ * PITCH ESTIMATORS: processBlock only fills the AudioBufferFifo. Every hop pulled out of it goes to a PitchEstimator (PitchEstimator.h).
+ * The default one is the FFT phase vocoder described below. McLeodPitchEstimator is a time domain alternative with a much shorter window.
+ * OctavePyramidEstimator is a multirate one: half-band decimators and a small FFT per octave, so only bass notes wait for a long window.
+ *
  * MAKING THE FFT: THE BASIC IDEA
- * We are forming a FIFO (circular buffer) of AudioBufferFIFOs.
- * The samples in the buffer that processBlock gets from the DAW is put into a bufferToFill inside AudioBufferFifo
- * Once AudioBufferFIFO's bufferToFill is full, it gets pushed onto a FifoStructure
- * On every call to processBlock, we pull buffers from the AudioBufferFifo and copy them to the end of another buffer. Then we take the FFT of that other buffer.
- * This happens for every complete buffer in the AudioBufferFIFO. If the AudioBufferFIFO is in a state where there is more than 1 complete buffer available, the FFT will be taken multiple times in processBlock. However, most of the time there should only be 1 buffer available
+ * The samples in the buffer that processBlock gets from the DAW are copied into a sample ring inside AudioBufferFifo
+ * On every call to processBlock, we pull hop-sized buffers from the AudioBufferFifo and write them over the oldest samples of a circular history buffer. Then we take the FFT of that history.
+ * The hop is set by the analysis rate/overlap, not by the DAW's buffer size. So depending on the buffer size there can be 0, 1 or several FFTs in one processBlock, but always the same number per second of audio
+ *
+ * The FFTDataGenerator has a preallocated pool of FFT frames. The FFT is done in place in a pool frame, and only frame indexes move between producer and consumer.
+ * We look at the 2 oldest frames in place to find the exact maximum frequency, then hand the older one back to the pool.
+ * For order2048/4096/8192 the processor uses FixedOrderFFTDataGenerator instead (FFTFrameGenerator.h): the same thing with the
+ * order as a template parameter, so the frames are std::arrays and the loop bounds are constants. setFixedOrderFFT(false) goes back to this one.
+ *
+ * TRACKING MODE (optional): once a reading is found, a SlidingDFTTracker follows a few bins around it sample by sample and the
+ * FFT is skipped. We go back to the full FFT when the peak moves away from the locked bin, the level drops, or once a second to re-check.
  *
- * The FFTDataGenerator also has its own FifoStructure to hold FFT outputs. We use the 2 top entries to find the exact maximum frequency
+ * STRUM MODE (optional): besides the single reading, every FFT frame pair is searched for up to maxPolyphonicReadings notes at once.
+ * Local maxima in the low part of the spectrum are grouped by harmonics, and each group's fundamental gets its own phase difference reading.
+ *
+ * ADAPTIVE FFT ORDER (optional): the history is always masterFFTLength long, and every FFT order from 2048 up has its own FFTDataGenerator
+ * that takes the newest 2^order samples of it. After each reading we pick the smallest order that still puts the fundamental
+ * far enough up the spectrum. Short windows for treble, long ones for bass.
  */
 
 
-// The FIFO/FFT structure/flow heavily borrows from the SimpleEQ project tutorial by MatkatMusic. I iterate upon it by adding the pullTopViewNext function
-template<typename BufferType>
-class FifoStructure
+// The FIFO/FFT structure/flow heavily borrows from the SimpleEQ project tutorial by MatkatMusic. I iterate upon it by viewing the top 2 FFT frames at once (previously the pullTopViewNext function)
+template<typename BlockType> //juce::AudioBuffer<float>
+class AudioBufferFifo
 {
+//The SimpleEQ project by MatkatMusic was designed for multi-channel, and so is this one again: every input channel gets its own plane in the ring.
+//All the planes share 1 AbstractFifo, so the read/write positions are worked out once per block, not once per channel,
+//and each plane is contiguous so every copy is a plain vector copy.
+//The size in this class is the analysis hop. The DAW can push blocks of any size (up to maxBlockSize), and they're pulled back out hop by hop.
+//
+//Previously every sample went through pushNextSampleIntoFifo/setSample and every full buffer was copy-assigned into a FifoStructure.
+//Now the samples go into one preallocated single-producer/single-consumer ring, and each host block is copied in at most 2 contiguous segments.
+//Nothing is allocated or resized outside of prepare(), so update() and getAudioBuffer() are safe on the audio thread.
+//
+//Gaps: when a block is dropped the stream has a hole in it, and a phase difference measured across that hole is wrong.
+//The producer remembers how many samples it lost and where, and hands that over in a small gap queue with the next block that fits.
+//getAudioBuffer reports the samples lost inside (or right before) the hop it pulled, so the analysis can stop any window from spanning them.
 public:
-    void prepare(int numChannels, int numSamples)
+    AudioBufferFifo()
     {
-        static_assert( std::is_same_v<BufferType, juce::AudioBuffer<float>>,
-                              "prepare(numChannels, numSamples) should only be used when the Fifo is holding juce::AudioBuffer<float>");
-        for (auto& buffer : bufferArray)
-        {
-            buffer.setSize(1,             //newNumChannels
-                           numSamples,    //newNumSamples
+        prepared.set(false);
+    }
+
+    //This gets called when the DAW buffer size, sample rate or channel count changes (when prepareToPlay is called)
+    //capacity is in hops/host blocks. The low memory mode uses 2, just enough for a block and a hop
+    void prepare(int numChannelsToUse, int hopSize, int maxBlockSize, int capacity = BufferCapacity)
+    {
+        prepared.set(false);
+        size.set(hopSize);
+        numChannels = numChannelsToUse;
+        
+        //Room for capacity of whichever is bigger, +1 because AbstractFifo always keeps 1 slot empty
+        const int ringSize = juce::jmax(2, capacity)*juce::jmax(hopSize, maxBlockSize) + 1;
+        ringBuffer.setSize(numChannels,   //newNumChannels
+                           ringSize,      //newNumSamples
                            false,         //keepExistingContent
                            true,          //clearExtraSpace
                            true);         //avoidReallocating if smaller
-            buffer.clear();
-        }
-        emptyBuffer.setSize(1,             //newNumChannels
-                       numSamples,    //newNumSamples
-                       false,         //keepExistingContent
-                       true,          //clearExtraSpace
-                       true);         //avoidReallocating if smaller
-        emptyBuffer.clear();
-        
+        ringBuffer.clear();
+        sampleFifo.setTotalSize(ringSize);
+        sampleFifo.reset();
+        gapFifo.reset();
+        numSamplesWritten = 0;
+        numSamplesRead = 0;
+        numSamplesLostSinceLastWrite = 0;
+        prepared.set(true);
     }
     
-    void prepare(size_t numElements)
+    bool update(const BlockType& buffer)
     {
-        static_assert( std::is_same_v<BufferType, std::vector<float>>,
-                              "prepare(numElements) should only be used when the Fifo is holding std::vector<float>");
-                for( auto& buffer : bufferArray )
-                {
-                    buffer.clear();
-                    buffer.resize(numElements, 0);
-                }
+        //Returns false if the block was dropped
+        jassert(prepared.get()); //we don't want to use isPrepared() to save 1 function call
+        jassert(buffer.getNumChannels() > 0);
         
-        emptyBuffer.clear();
-        emptyBuffer.resize(numElements, 0);
-    }
-    
-    bool push(const BufferType& bufferToInsert)
-    {
-        auto write = abstractFifoTrackerObject.write(1); //returns a juce::AbstractFifo::ScopedReadWrite<read> object with member vars
-                //int startIndex1 = on exit, this will contain the start index in your buffer at which your data should be written
-                //int blockSize1 = on exit, this indicates how many items can be written to the block starting at startIndex1
-                //int startIndex2 = on exit, this will contain the start index in your buffer at which any data that didn't fit into the first block should be written
-                //int blockSize2 = on exit, this indicates how many items can be written to the block starting at startIndex2
+        const int numSamples = buffer.getNumSamples();
+        
+        //If the whole block doesn't fit, drop it. Writing half a block would put a gap in the middle of an analysis hop.
+        //Consecutive drops are 1 gap, and it's only published once a block gets written after it
+        if (sampleFifo.getFreeSpace() < numSamples || ! publishGap())
+        {
+            numSamplesLostSinceLastWrite += numSamples;
+            return false;
+        }
         
-        if (write.blockSize1 > 0) //If there's space in the fifo for the buffer
+        auto write = sampleFifo.write(numSamples);
+        numSamplesWritten += numSamples;
+        const int numChannelsInBlock = juce::jmin(numChannels, buffer.getNumChannels());
+        
+        for (int channel = 0; channel < numChannels; ++channel)
         {
-            bufferArray[write.startIndex1] = bufferToInsert; //write the buffer to the block
-            return true; //the push succeeded
+            if (channel >= numChannelsInBlock)
+            {
+                //The host gave us fewer channels than we were prepared for. The missing ones are silent, so every plane stays in step
+                ringBuffer.clear(channel, write.startIndex1, write.blockSize1);
+                ringBuffer.clear(channel, write.startIndex2, write.blockSize2);
+                continue;
+            }
+            
+            auto* bufferPtr = buffer.getReadPointer(channel);
+            if (write.blockSize1 > 0)
+            {
+                juce::FloatVectorOperations::copy(ringBuffer.getWritePointer(channel, write.startIndex1), bufferPtr, write.blockSize1);
+            }
+            if (write.blockSize2 > 0) //the part that wrapped around to the start of the ring
+            {
+                juce::FloatVectorOperations::copy(ringBuffer.getWritePointer(channel, write.startIndex2), bufferPtr+write.blockSize1, write.blockSize2);
+            }
         }
-        return false; //the push did not succeed
+        return true;
     }
     
-    bool pull(BufferType& bufferToHold)
+    int getNumCompleteBuffersAvailable() const {return sampleFifo.getNumReady()/size.get();}
+    int getNumSamplesAvailable() const {return sampleFifo.getNumReady();}
+    int getCapacity() const {return sampleFifo.getTotalSize()-1;}
+    size_t getMemoryBytes() const {return static_cast<size_t>(ringBuffer.getNumChannels()*ringBuffer.getNumSamples())*sizeof(float) + sizeof(gaps);}
+    bool isPrepared() const {return prepared.get();}
+    int getSize() const {return size.get();}
+    int getNumChannels() const {return numChannels;}
+    
+    bool getAudioBuffer(BlockType& buf)
     {
-        auto read = abstractFifoTrackerObject.read(1); //read from the top of the fifo
-        if (read.blockSize1 > 0) //if we could read something
-        {
-            bufferToHold = bufferArray[read.startIndex1];
-            return true; //succeeded
-        }
-        return false; //failed
+        juce::int64 numSamplesLost;
+        return getAudioBuffer(buf, numSamplesLost);
     }
     
-    int pullTopViewNext(BufferType& bufferToHold1, BufferType& bufferToHold2)
+    //numSamplesLost is how many samples went missing somewhere in the hop that was pulled (0 almost always)
+    bool getAudioBuffer(BlockType& buf, juce::int64& numSamplesLost)
     {
-        //function returns the number of buffers we were able to see
-        int startIndex1, blockSize1, startIndex2, blockSize2;
+        numSamplesLost = 0;
         
-        abstractFifoTrackerObject.prepareToRead(2, startIndex1, blockSize1, startIndex2, blockSize2);
+        //buf has to be sized to getNumChannels() x getSize() before the audio thread starts (in prepareToPlay). We don't resize it here
+        const int bufferSize = size.get();
+        jassert(buf.getNumSamples() >= bufferSize);
+        jassert(buf.getNumChannels() >= numChannels);
         
-        //If there's no blocks available to read, do nothing (return false)
-        if (blockSize1 == 0)
+        if (sampleFifo.getNumReady() < bufferSize)
         {
-            return 0;
+            return false;
         }
         
-        //If startIndex1 only has space for 1 block, the other block should be at startIndex2
-        else if (blockSize1 == 1)
+        auto read = sampleFifo.read(bufferSize);
+        
+        for (int channel = 0; channel < numChannels; ++channel)
         {
-            bufferToHold1 = bufferArray[startIndex1];
-            
-            if (blockSize2 > 0)
+            juce::FloatVectorOperations::copy(buf.getWritePointer(channel), ringBuffer.getReadPointer(channel, read.startIndex1), read.blockSize1);
+            if (read.blockSize2 > 0)
             {
-                bufferToHold2 = bufferArray[startIndex2];
-                abstractFifoTrackerObject.finishedRead(1); //Discard startIndex1, keep startIndex2
-                return 2;
+                juce::FloatVectorOperations::copy(buf.getWritePointer(channel, read.blockSize1), ringBuffer.getReadPointer(channel, read.startIndex2), read.blockSize2);
             }
-            
-            bufferToHold2 = emptyBuffer;
-            
-            //Previously we did if there's only 1 buffer available to pull, don't destroy it.
-            //That backfired and caused an infinite loop in the FFT while function. So We will see if destroying the single block helps...
-            abstractFifoTrackerObject.finishedRead(1);
-            return 1;
         }
-        
-        else if (blockSize1 > 1)
-        {
-            bufferToHold1 = bufferArray[startIndex1];
-            bufferToHold2 = bufferArray[startIndex1+1];
-            abstractFifoTrackerObject.finishedRead(1); //Discard buffer1, keep buffer2
-            return 2;
-        }
-        
-        else
+        numSamplesLost = takeGapsBefore(numSamplesRead + bufferSize);
+        numSamplesRead += bufferSize;
+        return true;
+    }
+    
+    //Consumer side. Throws away the oldest numSamples without copying them (OverloadPolicy::dropOldest).
+    //Returns how many it actually threw away (no more than are waiting, 0 if there's nothing to drop).
+    //numSamplesLost is how many that loses, counting any gaps the producer left in that stretch
+    int discardOldest(int numSamples, juce::int64& numSamplesLost)
+    {
+        numSamplesLost = 0;
+        numSamples = juce::jlimit(0, sampleFifo.getNumReady(), numSamples); //never negative, that would move the read position back
+        if (numSamples == 0)
         {
             return 0;
         }
+        sampleFifo.finishedRead(numSamples);
+        
+        numSamplesLost = numSamples + takeGapsBefore(numSamplesRead + numSamples);
+        numSamplesRead += numSamples;
+        return numSamples;
     }
     
-    int getNumAvailableForReading() const {return abstractFifoTrackerObject.getNumReady();}
-    
 private:
-    static constexpr int BufferCapacity = 30;
-    std::array<BufferType, BufferCapacity> bufferArray;
-    juce::AbstractFifo abstractFifoTrackerObject {BufferCapacity}; //This keeps track of the pointers for a circular buffer structure
-    BufferType emptyBuffer;
-    
-};
-
-template<typename BlockType> //juce::AudioBuffer<float>
-class AudioBufferFifo
-{
-//The SimpleEQ project by MatkatMusic was designed for multi-channel. Here I only support single channel
-//In implementation, the bufferSize The bufferSize in this class is the same as the samplesPerBlock that the DAW works with.
-public:
-    AudioBufferFifo()
-    {
-        prepared.set(false);
-    }
-
-    //This gets called when the DAW buffer size or sample rate changes (when prepareToPlay is called)
-    void prepare(int bufferSize)
+    struct Gap
     {
-        prepared.set(false);
-        size.set(bufferSize);
-        
-        bufferToFill.setSize(1,             //newNumChannels
-                             bufferSize,    //newNumSamples
-                             false,         //keepExistingContent
-                             true,          //clearExtraSpace
-                             true);         //avoidReallocating if smaller
-        fifoStructure.prepare(1, bufferSize);
-        bufferIndex = 0;
-        prepared.set(true);
-    }
+        juce::int64 position = 0; //in samples written, so the hole is right before the sample that was written at this count
+        juce::int64 numSamplesLost = 0;
+    };
     
-    void update(const BlockType& buffer)
+    //Producer side. False if the gap queue is full, and then the block has to be dropped too, or the gap would end up in the wrong place
+    bool publishGap()
     {
-        jassert(prepared.get()); //we don't want to use isPrepared() to save 1 function call
-        jassert(buffer.getNumChannels() > 0);
-        auto* bufferPtr = buffer.getReadPointer(0); //always use channel 0
-        
-        //go sample-by-sample pushing into the bufferToFill
-        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        if (numSamplesLostSinceLastWrite == 0)
+        {
+            return true;
+        }
+        if (gapFifo.getFreeSpace() < 1)
         {
-            pushNextSampleIntoFifo( bufferPtr[i] );
+            return false;
         }
+        
+        auto write = gapFifo.write(1);
+        gaps[static_cast<size_t>(write.startIndex1)] = {numSamplesWritten, numSamplesLostSinceLastWrite};
+        numSamplesLostSinceLastWrite = 0;
+        return true;
     }
     
-    int getNumCompleteBuffersAvailable() const {return fifoStructure.getNumAvailableForReading();}
-    bool isPrepared() const {return prepared.get();}
-    int getSize() const {return size.get();}
-    bool getAudioBuffer(BlockType& buf) {return fifoStructure.pull(buf);}
-    
-private:
-    juce::Atomic<bool> prepared = false; //Atomic to support multi-threading
-    juce::Atomic<int> size = 0; //the size of each buffer
-    BlockType bufferToFill; //is practically a juce::AudioBuffer<float>
-    FifoStructure<BlockType> fifoStructure;
-    int bufferIndex = 0; //keeps track of the position in the 
-    
-    void pushNextSampleIntoFifo(float sample)
+    //Consumer side. Pops every gap before the given read position
+    juce::int64 takeGapsBefore(juce::int64 endPosition)
     {
-        if ( bufferIndex == bufferToFill.getNumSamples() ) //wraparound
+        juce::int64 numSamplesLost = 0;
+        while (gapFifo.getNumReady() > 0)
         {
-            bool pushSucceeded = fifoStructure.push(bufferToFill); //push the full buffer on to the fifo
-            juce::ignoreUnused(pushSucceeded);
-            bufferIndex = 0;
+            int start1, size1, start2, size2;
+            gapFifo.prepareToRead(1, start1, size1, start2, size2);
+            const Gap& gap = gaps[static_cast<size_t>(start1)];
+            if (gap.position >= endPosition)
+            {
+                break; //belongs to a later hop
+            }
+            numSamplesLost += gap.numSamplesLost;
+            gapFifo.finishedRead(1);
         }
-        
-        bufferToFill.setSample(0, bufferIndex, sample); //ch0, index fifoIndex
-        ++bufferIndex;
+        return numSamplesLost;
     }
     
+    static constexpr int BufferCapacity = 30; //how many hops/host buffers the ring can hold
+    juce::Atomic<bool> prepared = false; //Atomic to support multi-threading
+    juce::Atomic<int> size = 0; //the hop size. getAudioBuffer always pulls exactly this many samples
+    int numChannels = 1; //only changes in prepare()
+    BlockType ringBuffer; //is practically a juce::AudioBuffer<float>, numChannels planes
+    juce::AbstractFifo sampleFifo {1}; //keeps track of the read/write positions in ringBuffer
+    
+    static constexpr int GapCapacity = 16; //AbstractFifo keeps 1 slot empty, so 15 gaps can be waiting
+    std::array<Gap, GapCapacity> gaps;
+    juce::AbstractFifo gapFifo {GapCapacity};
+    juce::int64 numSamplesWritten = 0; //producer only
+    juce::int64 numSamplesLostSinceLastWrite = 0; //producer only. Not published yet
+    juce::int64 numSamplesRead = 0; //consumer only
+    
 };
 
 template<typename BlockType>
-class FFTDataGenerator //using BlockType = std::vector<float>
+class FFTDataGenerator : public FFTFrameGenerator //using BlockType = std::vector<float>
 {
 public:
     FFTDataGenerator(int fftOrder)
@@ -226,52 +274,142 @@ public:
         order = fftOrder;
         int fftSize = getFFTSize();
         
-        fftObject = std::make_unique<juce::dsp::FFT>(order);
-        window = std::make_unique<juce::dsp::WindowingFunction<float>>(
-            fftSize,
-            juce::dsp::WindowingFunction<float>::blackmanHarris //was hann, now blackmanHarris to minimize SLL
-            );
+        //The plan and the window are shared with every other generator of this order in the process (SharedFFTResources.h)
+        fftObject = SharedFFTResources::getFFT(order);
         
-        fftData.clear();
-        fftData.resize(fftSize*2, 0);
+        //We keep the window as a plain table (instead of a juce::dsp::WindowingFunction) so it can be applied while gathering the samples
+        windowTable = SharedFFTResources::getWindow(fftSize, juce::dsp::WindowingFunction<float>::blackmanHarris); //was hann, now blackmanHarris to minimize SLL. Normalised
         
-        fftDataFifo.prepare(fftData.size());
+        //All frames are allocated here, once. After this, frames are only ever referred to by their index in framePool
+        for (auto& frame : framePool)
+        {
+            frame.clear();
+            frame.resize(fftSize*2, 0);
+        }
     }
     
-    void produceFFTData(const juce::AudioBuffer<float>& audioData)
+    bool produceFFTData(const juce::AudioBuffer<float>& audioData)
     {
-        //This function takes a full fftSize audio buffer and takes a windowed FFT
+        //This function takes a full fftSize audio buffer (oldest sample first) and takes a windowed FFT
+        return produceFFTData(audioData, 0);
+    }
+    
+    bool produceFFTData(const juce::AudioBuffer<float>& circularAudioData, int oldestSampleIndex, juce::int64 frameEndSample = 0) override
+    {
+        //This function takes a circular audio buffer and takes a windowed FFT of its newest fftSize samples.
+        //oldestSampleIndex is the oldest sample in the buffer. If the buffer is exactly fftSize long, that's where the window starts:
+        //the samples from there to the end come first, then the ones from 0 to oldestSampleIndex.
+        //If it's longer (several FFT orders sharing one history), the window starts fftSize samples before the newest sample.
+        //frameEndSample is the position (in the input stream) just after the newest sample, it's kept with the frame.
+        //The window multiplication is done in the same pass as the copy, so there's no separate shift/copy/multiply.
+        //Returns false if every frame in the pool is still waiting to be read (the frame is dropped, like a failed FIFO push)
         
         const int fftSize = getFFTSize();
+        const int historySize = circularAudioData.getNumSamples();
+        jassert(historySize >= fftSize);
+        jassert(oldestSampleIndex >= 0 && oldestSampleIndex < historySize);
         
-        fftData.assign(fftData.size(),0); //fftData is a std::vector in the example code. In the constructor fftData.size() should be fftSize*2.
-        
-        auto* readIndex = audioData.getReadPointer(0);
+        int startIndex1, blockSize1, startIndex2, blockSize2;
+        frameIndexFifo.prepareToWrite(1, startIndex1, blockSize1, startIndex2, blockSize2);
+        if (blockSize1 == 0)
+        {
+            return false; //no free frame. Skip the FFT entirely, nobody would see it
+        }
         
-        //now we fill the fftData block with the audio data...
-        std::copy(readIndex, readIndex+fftSize, fftData.begin()); //Since readIndex is a pointer to samples (memoryaddress), we copy the memory addresses to the fftData buffer.
-            //Only the first half is filled, the other half is all 0
+        float* fftData = framePool[startIndex1].data(); //the FFT goes straight into the pool, no copy afterwards
+        auto* readIndex = circularAudioData.getReadPointer(0);
+        const int windowStartIndex = (oldestSampleIndex + historySize - fftSize) % historySize;
+        const int numSamplesInFirstSegment = juce::jmin(fftSize, historySize-windowStartIndex);
         
-        //Apply a windowing function
-        window->multiplyWithWindowingTable(fftData.data(),fftSize);
+        //Each frame is fftSize*2 long. Only the first half is input, the FFT uses the second half as workspace so we don't have to clear it
+        juce::FloatVectorOperations::multiply(fftData, //dest
+                                              readIndex+windowStartIndex, //src1: oldest samples of the window
+                                              windowTable->data(), //src2: start of the window
+                                              numSamplesInFirstSegment);
+        if (numSamplesInFirstSegment < fftSize)
+        {
+            juce::FloatVectorOperations::multiply(fftData+numSamplesInFirstSegment,
+                                                  readIndex, //the newest samples wrapped around to the start
+                                                  windowTable->data()+numSamplesInFirstSegment,
+                                                  fftSize-numSamplesInFirstSegment);
+        }
         
         //Then perform the FFT
-        fftObject->performRealOnlyForwardTransform(fftData.data());
+        fftObject->performRealOnlyForwardTransform(fftData);
+        
+        //At this point the frame is now even-index=real part, odd-index=imag part. Publish it to the reader
+        frameEndSamples[startIndex1] = frameEndSample;
+        frameIndexFifo.finishedWrite(1);
+        return true;
+    }
+    
+    int viewTopAndNext(const float*& topFrame, const float*& nextFrame, juce::int64* nextFrameEndSample = nullptr) const override
+    {
+        //Gives pointers to the 2 oldest frames without copying or consuming them. topFrame is older than nextFrame.
+        //Returns the number of frames we were able to see. The frames stay valid until finishedWithTopFrame() is called
+        //If nextFrameEndSample isn't null, it gets the frameEndSample that nextFrame was produced with
+        int startIndex1, blockSize1, startIndex2, blockSize2;
+        frameIndexFifo.prepareToRead(2, startIndex1, blockSize1, startIndex2, blockSize2);
+        
+        if (blockSize1 == 0)
+        {
+            return 0;
+        }
+        
+        topFrame = framePool[startIndex1].data();
         
-        //At this point the fftData is now even-index=real part, odd-index=imag part
-        fftDataFifo.push(fftData);
+        if (blockSize1 == 1 && blockSize2 == 0)
+        {
+            return 1;
+        }
+        
+        const int nextIndex = (blockSize1 > 1) ? startIndex1+1 : startIndex2; //startIndex2 if the next frame wrapped around to the start of the pool
+        nextFrame = framePool[nextIndex].data();
+        if (nextFrameEndSample != nullptr)
+        {
+            *nextFrameEndSample = frameEndSamples[nextIndex];
+        }
+        return 2;
+    }
+    
+    void finishedWithTopFrame() override {frameIndexFifo.finishedRead(1);} //the older frame goes back to the pool. nextFrame becomes the top
+    
+    int getFFTSize() const override { return 1 << order; }
+    int getNumAvailableFFTDataBlocks() const override { return frameIndexFifo.getNumReady();}
+    void reset() override { frameIndexFifo.reset(); } //forget every unread frame. Not thread safe, only call when nobody is reading/writing
+    
+    size_t getMemoryBytes() const override
+    {
+        size_t numBytes = sizeof(*this);
+        for (const auto& frame : framePool)
+        {
+            numBytes += frame.capacity()*sizeof(float);
+        }
+        return numBytes;
+    }
+    
+    bool getFFTData(BlockType& fftData)
+    {
+        //Copies the oldest frame out and consumes it. For tools/tests, the audio thread uses viewTopAndNext
+        const float* topFrame;
+        const float* nextFrame;
+        if (viewTopAndNext(topFrame, nextFrame) == 0)
+        {
+            return false;
+        }
+        fftData.assign(topFrame, topFrame+getFFTSize()*2);
+        finishedWithTopFrame();
+        return true;
     }
     
-    int pullTopViewNext(BlockType& bufferToHold1, BlockType& bufferToHold2) {return fftDataFifo.pullTopViewNext(bufferToHold1, bufferToHold2);}
-    int getFFTSize() const { return 1 << order; }
-    int getNumAvailableFFTDataBlocks() const { return fftDataFifo.getNumAvailableForReading();}
-    bool getFFTData(BlockType& fftData) {return fftDataFifo.pull(fftData);}
 private:
-    BlockType fftData; //std::vector<float>
-    std::unique_ptr<juce::dsp::FFT> fftObject;
-    std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
+    static constexpr int FrameCapacity = 30;
+    std::array<BlockType, FrameCapacity> framePool; //using BlockType = std::vector<float>
+    std::array<juce::int64, FrameCapacity> frameEndSamples {}; //the frameEndSample each framePool entry was produced with
+    juce::AbstractFifo frameIndexFifo {FrameCapacity}; //keeps track of which framePool entries are written and not read yet
+    std::shared_ptr<const juce::dsp::FFT> fftObject;
+    std::shared_ptr<const std::vector<float>> windowTable; //Blackman-Harris, fftSize long
     int order;
-    FifoStructure<BlockType> fftDataFifo; //using BlockType = std::vector<float>
 };
 
 
@@ -279,7 +417,7 @@ class SimpleTunerAudioProcessor  : public juce::AudioProcessor
 {
 public:
     //==============================================================================
-    SimpleTunerAudioProcessor();
+    SimpleTunerAudioProcessor(int fftOrder = FFTOrder::order8192); //the plugin always uses order8192, other orders are for the benchmark/batch tools
     ~SimpleTunerAudioProcessor() override;
 
     //==============================================================================
@@ -317,12 +455,131 @@ public:
     
     //My Variables==================================================================
 
+    //These work on channel 0's FFT state, for the tools that call the analysis directly
+    template<typename DataType>
+    int findComplexMaxIndex(const DataType* fftDataVector );
     template<typename DataType>
-    int findComplexMaxIndex(std::vector<DataType>& fftDataVector );
+    int findComplexMaxIndexReference(const DataType* fftDataVector ); //the original scalar version, for testing/benchmarking
+    template<typename DataType>
+    int fundamentalFrequencyChecker(int i, float magI, const DataType* fftDataVector);
+    
+    float findExactMaxFrequency(const float* fifoFFTData1, const float* fifoFFTData2);
+    float phaseDifferenceToFrequency(int binNumber, float topPhase, float nextPhase); //the phase vocoder part of findExactMaxFrequency
+    
+    float getCurrentExactF(int channel = 0);
+    
+    //Everything about the newest reading of a channel, from 1 frame: frequency, magnitude, confidence, note, cents and sample time.
+    //runAnalysis writes it once per frame through a seqlock (TunerReading.h), so any thread can read it without locks or allocating.
+    //version goes up by 1 with every reading, so a reader can tell a new one from the one it already has.
+    //The getCurrentXxx getters below each read 1 field of this
+    TunerReading getCurrentReading(int channel = 0, juce::uint32* version = nullptr) const;
+    
+    //Every input channel is analysed on its own, up to maxAnalysisChannels (eg. a whole stage box in one instance).
+    //The channel count comes from the bus layout at prepareToPlay. The getters with a channel argument are safe from any thread
+    static constexpr int maxAnalysisChannels = 32;
+    int getNumAnalysisChannels() const;
+    
+    //When on, processBlock only copies samples into bufferFifo and a background thread does the FFT/peak search.
+    //Takes effect on the next prepareToPlay. releaseResources stops the thread
+    void setBackgroundAnalysis(bool shouldUseBackgroundThread);
+    bool isUsingBackgroundAnalysis() const;
+    
+    //The analysis hop (new samples between FFTs) doesn't depend on the host's block size. Pick it either as a rate or as an overlap.
+    //Whichever was set last is used. Takes effect on the next prepareToPlay
+    void setAnalysisRate(double readingsPerSecond); //hop = sampleRate/readingsPerSecond
+    void setAnalysisOverlap(float overlapFraction); //hop = fftLength*(1-overlapFraction), eg. 0.75 -> fftLength/4
+    int getAnalysisHopSize() const; //in host samples (a multiple of the decimation factor), valid after prepareToPlay
+    juce::int64 getCurrentReadingSampleTime(int channel = 0); //sample position (since prepareToPlay) at the end of the newest frame of the last reading
+    static constexpr double defaultAnalysisRate = 50.0; //the display runs at 12fps, 50 readings per second is plenty
+    static constexpr int minAnalysisHopSize = 32;
+    float getCurrentPeakMagnitude(int channel = 0); //magnitude of the FFT bin used for the last reading
     
-    float findExactMaxFrequency(std::vector<float>& fifoFFTData1, std::vector<float>& fifoFFTData2);
+    //When on, a locked note is followed with a sliding DFT over a few bins instead of a full FFT every hop. Takes effect immediately
+    void setTrackingMode(bool shouldTrackLockedPeak);
+    bool isUsingTrackingMode() const;
     
-    float getCurrentExactF();
+    //When on, every phase vocoder reading from the newest frame is cross-checked with a zoom transform around the FFT's peak bin
+    //(ZoomTransform.h), which finds the peak from that 1 frame. The frequency is still the phase difference's, but further than
+    //zoomAgreementCents from the zoom the reading's confidence drops. Flags the readings a short FFT gets wrong (low notes in a
+    //2048 window, noise). Not the tracker or strum mode. Takes effect immediately
+    void setZoomCrossCheck(bool shouldCrossCheckWithZoom);
+    bool isUsingZoomCrossCheck() const;
+    
+    //Which PitchEstimator runs the analysis. Set it per instance, takes effect on the next prepareToPlay.
+    //Tracking mode and adaptive FFT order only apply to fftPhaseVocoder
+    enum EstimatorType {fftPhaseVocoder = 0, mcLeodPitchMethod = 1, octavePyramid = 2};
+    void setEstimatorType(EstimatorType newType);
+    EstimatorType getEstimatorType() const;
+    juce::String getEstimatorName() const;
+    int getCurrentWindowLength(int channel = 0) const; //samples of history behind the last reading (the FFT length for fftPhaseVocoder)
+    
+    //Strum mode: up to maxPolyphonicReadings notes at once, eg. all 6 strings of a guitar. FFT phase vocoder and channel 0 only,
+    //and it turns tracking off on that channel (the tracker only follows 1 peak). Takes effect immediately
+    static constexpr int maxPolyphonicReadings = 6;
+    void setPolyphonicMode(bool shouldFindSeveralNotes);
+    bool isUsingPolyphonicMode() const;
+    int getPolyphonicReadings(std::array<float, maxPolyphonicReadings>& frequencies) const; //lowest note first. Returns how many there are
+    
+    //Frequency -> note and cents (NoteMapper.h): any A4 reference, a temperament and a stretch. It lives here so the settings
+    //outlive the editor, and the analysis maps every reading with it (TunerReading::noteIndex/cents).
+    //Message thread only: change a copy and hand it back with setNoteMapper, which passes it to the analysis through a seqlock.
+    //The readings use it from the next frame on
+    const NoteMapper& getNoteMapper() const { return noteMapper; }
+    void setNoteMapper(const NoteMapper& newNoteMapper);
+    NoteReading getCurrentNote(int channel = 0) { return noteMapper.map(getCurrentExactF(channel)); }
+    
+    //When on, the FFT order follows the detected pitch (between order2048 and masterFFTOrder) instead of always being masterFFTOrder.
+    //Takes effect on the next prepareToPlay. The hop is limited to 2048/4 in this mode so the phase difference works for every order
+    void setAdaptiveFFTOrder(bool shouldAdaptFFTOrder);
+    bool isUsingAdaptiveFFTOrder() const;
+    int getCurrentFFTOrder(int channel = 0) const; //the order the last reading came from
+    int getCurrentFFTLength(int channel = 0) const { return 1 << getCurrentFFTOrder(channel); }
+    
+    //When on (the default), order2048/4096/8192 use FixedOrderFFTDataGenerator, the compile time specialised frame generator.
+    //Off is the runtime sized FFTDataGenerator, for comparing the two. Takes effect on the next prepareToPlay
+    void setFixedOrderFFT(bool shouldUseFixedOrderFFT);
+    bool isUsingFixedOrderFFT() const;
+    
+    //Low memory mode keeps only what the phase difference needs: the sample history, 1 in place FFT workspace (PackedRealFFT.h) shared by the channels,
+    //and per channel a few numbers about the previous frame's peak (its bin, magnitude and phase) instead of a pool of 30 whole frames.
+    //The readings are the same to float rounding. The sample ring only holds 2 blocks, so it's meant for analysis on the audio thread, and strum mode is off.
+    //A mono instance is about 86 KB at order8192 (the README has the numbers).
+    //Takes effect on the next prepareToPlay
+    void setLowMemoryMode(bool shouldUseLowMemory);
+    bool isUsingLowMemoryMode() const;
+    
+    //When on (the default), from 88.2 kHz up every hop is low-pass filtered and decimated (PolyphaseDecimator.h) before the estimators,
+    //so the analysis always runs at 44.1/48 kHz: the same FFT cost and Hz per bin at any host rate. Readings are still timed in host samples.
+    //Off analyses the host rate as it is. Takes effect on the next prepareToPlay
+    void setDecimation(bool shouldDecimate);
+    bool isUsingDecimation() const;
+    int getDecimationFactor() const { return decimationFactor; } //1 at 44.1/48k or when it's off. Valid after prepareToPlay
+    double getAnalysisSampleRate() const { return analysisSampleRate; } //the host rate divided by that
+    
+    //Heap + object memory this instance holds after prepareToPlay. FFT plans and window tables are shared by every instance
+    //(SharedFFTResources.h) and aren't counted. Not thread safe, call it when the analysis isn't running (eg. after prepareToPlay)
+    struct MemoryFootprint
+    {
+        size_t processorObjects = 0; //the processor, and the per channel objects (without what they allocate)
+        size_t sampleFifo = 0; //the sample ring and 1 hop of every channel (and 1 decimated hop)
+        size_t estimators = 0; //every channel's estimators: sample history, FFT frames, and its decimator
+        size_t scratch = 0; //shared by the channels: spectrum magnitudes, the low memory FFT workspace
+        
+        size_t getTotal() const { return processorObjects + sampleFifo + estimators + scratch; }
+    };
+    MemoryFootprint getMemoryFootprint() const;
+    
+    //What the analysis has cost since the last prepareToPlay (see AnalysisInstrumentation.h). Safe from any thread
+    AnalysisInstrumentation::Snapshot getInstrumentationSnapshot() const;
+    
+    //What runAnalysis does when it finds more than half of the sample ring waiting (it has fallen behind, eg. a starved background thread).
+    //dropOldest throws the backlog away and leaves a gap, coalesceToLatest runs the backlog into the history without FFTs and reads
+    //only the newest hops, skipAnalysisUntilCaughtUp keeps skipping the FFTs until there's at most 1 hop waiting.
+    //If the ring does fill up anyway, the newest block is dropped and that's a gap too. The estimators never read across a gap.
+    //Takes effect immediately
+    enum OverloadPolicy {dropOldest = 0, coalesceToLatest = 1, skipAnalysisUntilCaughtUp = 2};
+    void setOverloadPolicy(OverloadPolicy newPolicy);
+    OverloadPolicy getOverloadPolicy() const;
     
     float wrapToPi(float phi)
     {
@@ -333,31 +590,291 @@ public:
     }
     
     enum FFTOrder {order2048 = 11, order4096 = 12, order8192 = 13};
-    const int masterFFTOrder = FFTOrder::order8192; // was 11 (2048, 23.43Hz res @ 48kHz) now 13 (8192, 5.46Hz res @ 48kHz)
+    const int masterFFTOrder; // default is order8192. was 11 (2048, 23.43Hz res @ 48kHz) now 13 (8192, 5.46Hz res @ 48kHz)
     const int masterFFTLength = 1 << masterFFTOrder;
 
 private:
     //==============================================================================
     
+    class AnalysisThread : public juce::Thread
+    {
+    public:
+        AnalysisThread(SimpleTunerAudioProcessor& processorToAnalyze, int pollIntervalMilliseconds)
+            : juce::Thread("Tuner analysis"), processor(processorToAnalyze), pollIntervalMs(pollIntervalMilliseconds) {}
+        
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                processor.runAnalysis();
+                wait(pollIntervalMs); //stopThread() wakes this up early
+            }
+        }
+        
+    private:
+        SimpleTunerAudioProcessor& processor;
+        const int pollIntervalMs;
+    };
+    
+    std::atomic<bool> backgroundAnalysis = false;
+    
+    //Everything the FFT phase vocoder keeps from one hop to the next, for 1 channel.
+    //Every analysis function takes the one it works on, so channels (and processors) never share it by accident
+    struct FFTChannelState
+    {
+        //Nothing big is allocated until buildFFTStructures (from prepareToPlay), so a template full of instances doesn't
+        //make 3.5MB of frames per channel before it knows whether it wants them
+        FFTChannelState(int masterFFTOrder, int channelNumber) : channelIndex(channelNumber)
+        {
+            analysisFFTLength = 1 << masterFFTOrder;
+            currentFFTOrder = masterFFTOrder;
+            fftThreshold = 0.001f*analysisFFTLength;
+        }
+        
+        //Allocates, so only from prepareToPlay
+        void buildFFTStructures(int masterFFTOrder, bool useFixedOrderFFT, bool useLowMemory)
+        {
+            fftStructures.clear();
+            fftStructures.shrink_to_fit();
+            usesFixedOrderFFT = useFixedOrderFFT;
+            usesLowMemory = useLowMemory;
+            fftStructuresBuilt = true;
+            previousFrame = {};
+            
+            analysisFFTLength = 1 << masterFFTOrder;
+            currentFFTOrder = masterFFTOrder;
+            fftThreshold = 0.001f*analysisFFTLength;
+            activeFFTStructure = nullptr;
+            if (useLowMemory)
+            {
+                return; //no frames, analyseHopWithFFT uses the processor's workspace and previousFrame
+            }
+            
+            for (int order = juce::jmin(static_cast<int>(FFTOrder::order2048), masterFFTOrder); order <= masterFFTOrder; ++order)
+            {
+                std::unique_ptr<FFTFrameGenerator> structure = useFixedOrderFFT ? makeFixedOrderFFTDataGenerator(order) : nullptr;
+                if (structure == nullptr)
+                {
+                    structure = std::make_unique< FFTDataGenerator< std::vector<float> > >(order); //no specialisation for this order
+                }
+                fftStructures.push_back(std::move(structure));
+            }
+            activeFFTStructure = fftStructures.back().get();
+        }
+        
+        const int channelIndex;
+        
+        juce::AudioBuffer<float> audioBufferForFFT; //circular, the last masterFFTLength samples
+        int fftHistoryWritePosition = 0; //where the next sample goes in audioBufferForFFT. Also the oldest sample
+        
+        std::vector< std::unique_ptr<FFTFrameGenerator> > fftStructures; //order2048 up to masterFFTOrder (the last one). The smaller ones are for adaptive mode
+        bool usesFixedOrderFFT = true;
+        bool usesLowMemory = false;
+        bool fftStructuresBuilt = false;
+        FFTFrameGenerator* activeFFTStructure = nullptr; //the one analyseHopWithFFT uses now. nullptr in low memory mode
+        
+        //Low memory mode: all the next reading needs from the newest frame (what findExactMaxFrequency takes from the top frame)
+        struct PreviousFrame
+        {
+            bool isValid = false;
+            int peakIndex = 0; //interleaved, like lastPeakIndex
+            float peakMagnitude = 0;
+            float peakPhase = 0;
+        };
+        PreviousFrame previousFrame;
+        int analysisFFTLength; //length of activeFFTStructure. Everything that looks at a spectrum uses this
+        int currentFFTOrder;
+        float fftThreshold; // 0.001 = -60dB. Scales with analysisFFTLength
+        float peakMagnitude = 0; //magnitude of the bin findExactMaxFrequency used last
+        int lastPeakIndex = 0; //interleaved index of that bin
+        
+        SlidingDFTTracker peakTracker;
+        std::array<float, SlidingDFTTracker::numTrackedBins*2> trackerPreviousBins {}; //the tracked bins one hop ago, for the phase difference
+        float trackerLockMagnitude = 0; //peak magnitude when we locked
+        int hopsSinceLock = 0;
+        
+        juce::int64 samplesSinceDiscontinuity = 0; //no FFT frames until the window is clear of the last gap. Huge after prepareToPlay
+        
+        JUCE_DECLARE_NON_COPYABLE (FFTChannelState) //activeFFTStructure points into fftStructures
+    };
+    
+    FFTChannelState& getFirstFFTChannel() { return channelAnalyses[0]->phaseVocoderEstimator.state; } //for the public channel 0 functions
+    
+    //The current FFT method as a PitchEstimator. It owns its channel's state, the code is all in the processor
+    class PhaseVocoderEstimator : public PitchEstimator
+    {
+    public:
+        PhaseVocoderEstimator(SimpleTunerAudioProcessor& processorToUse, int channelIndex)
+            : state(processorToUse.masterFFTOrder, channelIndex), processor(processorToUse) {}
+        
+        juce::String getName() const override { return "FFT phase vocoder"; }
+        void prepare(double sampleRate, int /*hopSize*/) override
+        {
+            processor.prepareFFTAnalysis(state, sampleRate);
+        }
+        bool processHop(const float* hopSamples, int numSamples, juce::int64 endSample, PitchReading& reading) override
+        {
+            return processor.analyseHopWithFFT(state, hopSamples, numSamples, endSample, reading);
+        }
+        void skipHop(const float* hopSamples, int numSamples) override
+        {
+            processor.skipHopWithFFT(state, hopSamples, numSamples);
+        }
+        void handleDiscontinuity() override
+        {
+            processor.handleFFTDiscontinuity(state);
+        }
+        int getWindowLength() const override { return state.analysisFFTLength; }
+        size_t getMemoryBytes() const override
+        {
+            size_t numBytes = static_cast<size_t>(state.audioBufferForFFT.getNumSamples())*sizeof(float);
+            for (const auto& fftStructure : state.fftStructures)
+            {
+                numBytes += fftStructure->getMemoryBytes();
+            }
+            return numBytes;
+        }
+        
+        FFTChannelState state;
+        
+    private:
+        SimpleTunerAudioProcessor& processor;
+    };
+    
+    //One per analysed input channel. Only runAnalysis and prepareToPlay touch these
+    struct ChannelAnalysis
+    {
+        ChannelAnalysis(SimpleTunerAudioProcessor& processorToUse, int channelIndex) : phaseVocoderEstimator(processorToUse, channelIndex) {}
+        
+        PhaseVocoderEstimator phaseVocoderEstimator;
+        McLeodPitchEstimator mcLeodEstimator;
+        OctavePyramidEstimator octavePyramidEstimator;
+        PitchEstimator* activeEstimator = &phaseVocoderEstimator; //picked in prepareToPlay
+        PolyphaseDecimator decimator; //host rate -> analysisSampleRate, in front of the estimator
+    };
+    std::vector< std::unique_ptr<ChannelAnalysis> > channelAnalyses; //grows in prepareToPlay, never shrinks. [0] is made in the constructor
+    int numAnalysisChannels = 1; //how many of channelAnalyses runAnalysis uses. Set in prepareToPlay
+    std::atomic<int> numPublishedChannels {1}; //the same, for the getters
+    
+    //What runAnalysis publishes for each channel. A fixed array so the getters never race with prepareToPlay adding channels
+    std::array<SeqlockSnapshot<TunerReading>, maxAnalysisChannels> channelReadings;
+    void publishReading(int channel, const PitchReading& reading); //maps it with analysisNoteMapper, then 1 write
+    
+    //The NoteMapper the analysis uses. setNoteMapper publishes only noteMapper's settings, and the analysis rebuilds its own tables
+    //from them when they change. Checked every hop
+    SeqlockSnapshot<NoteMapper::Settings> publishedNoteMapperSettings;
+    NoteMapper analysisNoteMapper;
+    juce::uint32 analysisNoteMapperVersion = 0;
+    void updateAnalysisNoteMapper();
+    
+    std::atomic<EstimatorType> estimatorType {EstimatorType::fftPhaseVocoder};
+    static PitchEstimator* getEstimator(ChannelAnalysis& analysis, EstimatorType type);
+    void prepareFFTAnalysis(FFTChannelState& channel, double sampleRate);
+    bool analyseHopWithFFT(FFTChannelState& channel, const float* samples, int numSamples, juce::int64 endSample, PitchReading& reading);
+    void skipHopWithFFT(FFTChannelState& channel, const float* samples, int numSamples);
+    void handleFFTDiscontinuity(FFTChannelState& channel);
+    void forgetFFTFrames(FFTChannelState& channel); //the next reading needs 2 new frames
+    bool readLowMemoryFrame(FFTChannelState& channel, juce::int64 endSample, PitchReading& reading);
+    
+    //Phase vocoder readings are believable when the peak is well above the noise threshold and the phase difference puts the
+    //frequency inside the peak's bin (a sine's biggest bin is never more than half a bin away). 1 at 30dB over the threshold
+    float getPhaseVocoderConfidence(const FFTChannelState& channel, int binNumber, float frequency, float magnitude) const;
+    static constexpr float fullConfidenceDecibelsAboveThreshold = 30.f;
+    
+    std::atomic<bool> trackingMode = false;
+    
+    std::atomic<bool> zoomCrossCheck = false;
+    static constexpr float zoomAgreementCents = 2.f;
+    void crossCheckWithZoom(FFTChannelState& channel, PitchReading& reading); //the newest frame has to be the current history
+    int trackerResyncIntervalHops = 50; //set in prepareToPlay to about 1 second
+    static constexpr float trackerDropRatio = 0.25f; //-12dB below the lock magnitude means the note has gone (or moved)
+    
+    std::atomic<bool> polyphonicMode = false;
+    std::array<std::atomic<float>, maxPolyphonicReadings> polyphonicFrequencies {};
+    std::atomic<int> numPolyphonicReadings {0};
+    
+    struct PolyphonicPeak
+    {
+        int bin;
+        float magnitude;
+        float frequency;
+        bool isHarmonic;
+    };
+    static constexpr int maxPolyphonicCandidates = 24; //the strongest local maxima we look at. This is what bounds the CPU per frame
+    static constexpr int maxPolyphonicHarmonic = 8;
+    static constexpr float polyphonicMinFrequency = 60.f, polyphonicMaxFrequency = 2000.f; //range of the candidates (fundamentals + harmonics)
+    static constexpr float polyphonicRelativeThreshold = 0.01f; //-40dB below the strongest peak
+    static constexpr float harmonicToleranceCents = 30.f; //strings are a bit inharmonic, the upper partials run sharp
+    static constexpr float harmonicSmoothnessRatio = 3.f; //a "harmonic" ~10dB above the partial below it is another string on top of it
+    void findPolyphonicPeaks(FFTChannelState& channel, const float* topFrame, const float* nextFrame);
+    
+    std::atomic<bool> adaptiveFFTOrder = false;
+    static constexpr float minFundamentalBin = 12.f; //the fundamental has to be at least this many bins up (12 periods in the window)
+    static constexpr float orderDownHysteresis = 1.25f; //going to a shorter window needs 25% more than that, so it doesn't flip-flop
+    void updateAdaptiveFFTOrder(FFTChannelState& channel, float frequency);
+    void switchFFTOrder(FFTChannelState& channel, int newOrder);
+    void lockTracker(FFTChannelState& channel);
+    void slideTracker(FFTChannelState& channel, const float* samples, int numSamples);
+    bool produceTrackerReading(FFTChannelState& channel, juce::int64 endSample, PitchReading& reading);
+    
+    std::atomic<double> analysisRate = defaultAnalysisRate;
+    std::atomic<float> analysisOverlap = 0.f; //0 means use analysisRate
+    int analysisHopSize = 512; //set in prepareToPlay. This is the hop the phase vocoder math uses, at analysisSampleRate
+    
+    std::atomic<bool> decimation = true;
+    int decimationFactor = 1; //host samples per analysis sample. The FIFO hop is analysisHopSize*decimationFactor
+    double analysisSampleRate = 44100; //what every estimator and the phase vocoder maths run at. Set in prepareToPlay
+    juce::AudioBuffer<float> decimatedBuffer; //1 hop of every channel at analysisSampleRate
+    juce::int64 numSamplesAnalysed = 0; //sample accurate position of the end of the FFT history
+    int computeAnalysisHopSize(double sampleRate) const;
+    std::unique_ptr<AnalysisThread> analysisThread; //only exists between prepareToPlay and releaseResources, and only if backgroundAnalysis
+    static constexpr int analysisThreadStopTimeoutMs = 2000;
+    void runAnalysis();
+    AnalysisInstrumentation instrumentation;
+    
+    std::atomic<OverloadPolicy> overloadPolicy {OverloadPolicy::skipAnalysisUntilCaughtUp};
+    static constexpr int hopsKeptOnOverload = 2; //dropOldest and coalesceToLatest keep this many of the newest hops. 2 frames make a reading
+    bool skippingUntilCaughtUp = false; //only runAnalysis touches this
+    int overloadThreshold = 0; //samples waiting in bufferFifo, set in prepareToPlay
+    bool isOverloaded() const;
+    void handleOverload(int& numHopsToCoalesce);
+    void handleLostSamples(juce::int64 numSamplesLost);
+    void startAnalysisThread(double sampleRate, int samplesPerBlock);
+    void stopAnalysisThread();
+    
     AudioBufferFifo< juce::AudioBuffer<float> > bufferFifo;
-    FFTDataGenerator< std::vector<float> > fftDataStructure {masterFFTOrder};
+    FFTFrameGenerator& getFFTStructureForOrder(FFTChannelState& channel, int order);
+    std::atomic<bool> fixedOrderFFT = true;
+    
+    std::atomic<bool> lowMemoryMode = false;
+    static constexpr int lowMemoryFifoCapacity = 2; //host blocks/hops in the sample ring
+    std::vector<float> lowMemoryFFTWorkspace; //masterFFTLength+2, only in low memory mode
+    std::vector< std::shared_ptr<const PackedRealFFT> > lowMemoryFFTPlans; //[masterFFTOrder-order], from SharedFFTResources. In place, unlike juce::dsp::FFT's 2N
+    std::vector< std::shared_ptr<const std::vector<float>> > analysisWindows; //the same, Blackman-Harris. Every mode, the zoom uses them too
+    void prepareFFTScratch(); //magnitudesSquaredScratch, the windows, and the workspace/plans in low memory mode
+    int getFFTWindowStartIndex(const FFTChannelState& channel) const; //where the active window starts in audioBufferForFFT
     
-    juce::AudioBuffer<float> dummyBuffer;
-    juce::AudioBuffer<float> audioBufferForFFT;
+    juce::AudioBuffer<float> dummyBuffer; //1 hop of every analysed channel
+    void writeToFFTHistory(FFTChannelState& channel, const float* samples, int numSamples);
     
     std::complex<float>* topFFTDataComplex;
     std::complex<float>* nextFFTDataComplex;
     
     template<typename DataType>
-    int fundamentalFrequencyChecker(int i, float magI, std::vector<DataType>& fftDataVector);
+    int findComplexMaxIndex(FFTChannelState& channel, const DataType* fftDataVector);
     template<typename DataType>
-    int checkSpecificHarmonic(int harmonicNumber, int i, float& magI, std::vector<DataType>& fftDataVector);
+    int findComplexMaxIndexReference(FFTChannelState& channel, const DataType* fftDataVector);
+    template<typename DataType>
+    int fundamentalFrequencyChecker(FFTChannelState& channel, int i, float magI, const DataType* fftDataVector);
+    float findExactMaxFrequency(FFTChannelState& channel, const float* fifoFFTData1, const float* fifoFFTData2);
+    float phaseDifferenceToFrequency(FFTChannelState& channel, int binNumber, float topPhase, float nextPhase);
     
-    std::atomic<float> currentExactF = 0;
-    float fftThreshold = 0.001*masterFFTLength; // 0.001 = -60dB
-
-    std::vector<float> topFFTData;
-    std::vector<float> nextFFTData;
+    template<typename DataType>
+    int checkSpecificHarmonic(FFTChannelState& channel, int harmonicNumber, int i, float& magI, const DataType* fftDataVector);
+    
+    std::vector<float> magnitudesSquaredScratch; //masterFFTLength/2, used by findPolyphonicPeaks. Empty in low memory mode
+    
+    NoteMapper noteMapper; //the message thread's, analysisNoteMapper is the analysis's copy
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SimpleTunerAudioProcessor)
     
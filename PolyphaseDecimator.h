@@ -0,0 +1,153 @@
+/*
+  ==============================================================================
+
+    PolyphaseDecimator.h
+    Low-pass filter and downsample by an integer factor, in polyphase form,
+    for the front of the analysis at high sample rates.
+
+    A tuner only needs what's below ~5 kHz, so at 96/192 kHz most of the
+    host's bandwidth is just more work for the FFT and wider bins. The
+    factor is picked from the sample rate (chooseFactor) so the analysis
+    always runs at 44.1/48 kHz: the same FFT cost and the same Hz per bin
+    as a 44.1/48k session, whatever the host rate.
+
+    The filter is a linear phase Kaiser FIR (juce::dsp::FilterDesign) that
+    keeps 0-5 kHz and is 90 dB down from half the output rate up, so nothing
+    aliases into the spectrum the analysis sees. Linear phase is a constant
+    delay, and a constant delay doesn't change a phase difference.
+
+    Polyphase: the taps are split into factor branches of numTaps/factor,
+    each one running at the output rate on every factor-th input sample.
+    Only the samples we keep are ever computed, so the cost is numTaps
+    multiplies per output sample, and each branch is 1 contiguous dot
+    product (SpectrumKernels::dotProduct, SIMD).
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "SpectrumKernels.h"
+
+class PolyphaseDecimator
+{
+public:
+    static constexpr double minOutputSampleRate = 44100.0;
+    static constexpr int maxFactor = 8; //384 kHz -> 48 kHz
+    static constexpr double passbandEdgeHz = 5000.0; //a bit over the top note of a piano. The default, a cascade (OctavePyramidEstimator) needs less
+    static constexpr float stopbandAttenuationDecibels = -90.f;
+
+    //The biggest power of 2 that keeps the output at minOutputSampleRate or more. 1 at 44.1/48k (then nothing is filtered)
+    static int chooseFactor(double sampleRate)
+    {
+        int factor = 1;
+        while (factor < maxFactor && sampleRate/(2*factor) >= minOutputSampleRate)
+        {
+            factor *= 2;
+        }
+        return factor;
+    }
+
+    //Allocates, so only from prepareToPlay
+    void prepare(double inputSampleRate, int newFactor, double passbandEdge = passbandEdgeHz)
+    {
+        factor = juce::jmax(1, newFactor);
+        if (factor == 1)
+        {
+            branchCoefficients.clear();
+            branchLines.clear();
+            tapsPerBranch = 0;
+            return;
+        }
+
+        //Passband up to passbandEdge, stopband from the output's Nyquist. The cutoff is in the middle of the transition
+        const double stopbandEdgeHz = 0.5*inputSampleRate/factor;
+        jassert(passbandEdge < stopbandEdgeHz);
+        const auto design = juce::dsp::FilterDesign<float>::designFIRLowpassKaiserMethod(static_cast<float>(0.5*(passbandEdge + stopbandEdgeHz)),
+                                                                                           inputSampleRate,
+                                                                                           static_cast<float>((stopbandEdgeHz - passbandEdge)/inputSampleRate),
+                                                                                           stopbandAttenuationDecibels);
+        const float* taps = design->getRawCoefficients();
+        const int numTaps = static_cast<int>(design->getFilterOrder()) + 1;
+
+        double dcGain = 0;
+        for (int i = 0; i < numTaps; ++i)
+        {
+            dcGain += taps[i];
+        }
+
+        //Branch p gets taps p, p+factor, p+2*factor... (zero padded to a whole number per branch),
+        //stored oldest first so it lines up with the branch's delay line
+        tapsPerBranch = (numTaps + factor - 1)/factor;
+        branchCoefficients.assign(static_cast<size_t>(factor*tapsPerBranch), 0.f);
+        for (int branch = 0; branch < factor; ++branch)
+        {
+            for (int j = 0; j < tapsPerBranch; ++j)
+            {
+                const int tap = j*factor + branch;
+                const float coefficient = (tap < numTaps) ? static_cast<float>(taps[tap]/dcGain) : 0.f;
+                branchCoefficients[static_cast<size_t>(branch*tapsPerBranch + tapsPerBranch-1-j)] = coefficient;
+            }
+        }
+
+        branchLines.assign(static_cast<size_t>(factor*2*tapsPerBranch), 0.f);
+        reset();
+    }
+
+    //Silence in the delay lines, eg. after a gap in the input
+    void reset()
+    {
+        std::fill(branchLines.begin(), branchLines.end(), 0.f);
+        linePosition = 0;
+    }
+
+    //numInput has to be a multiple of the factor (the analysis hop is), so every call starts on the same phase.
+    //Writes numInput/factor samples and returns how many. output can't be input
+    int process(const float* input, int numInput, float* output)
+    {
+        jassert(numInput % factor == 0);
+        if (factor == 1)
+        {
+            juce::FloatVectorOperations::copy(output, input, numInput);
+            return numInput;
+        }
+
+        const int numOutput = numInput/factor;
+        for (int n = 0; n < numOutput; ++n)
+        {
+            //Input sample n*factor + i is the newest sample of branch factor-1-i. Each line is written twice,
+            //so its newest tapsPerBranch samples are always contiguous (from linePosition+1)
+            const float* group = input + n*factor;
+            for (int i = 0; i < factor; ++i)
+            {
+                float* line = branchLines.data() + (factor-1-i)*2*tapsPerBranch;
+                line[linePosition] = group[i];
+                line[linePosition + tapsPerBranch] = group[i];
+            }
+
+            float sum = 0;
+            for (int branch = 0; branch < factor; ++branch)
+            {
+                sum += SpectrumKernels::dotProduct(branchCoefficients.data() + branch*tapsPerBranch,
+                                                   branchLines.data() + branch*2*tapsPerBranch + linePosition+1,
+                                                   tapsPerBranch);
+            }
+            output[n] = sum;
+            linePosition = (linePosition+1) % tapsPerBranch;
+        }
+        return numOutput;
+    }
+
+    int getFactor() const { return factor; }
+    int getNumTaps() const { return factor*tapsPerBranch; }
+    size_t getMemoryBytes() const { return (branchCoefficients.capacity() + branchLines.capacity())*sizeof(float); }
+
+private:
+    int factor = 1;
+    int tapsPerBranch = 0;
+    int linePosition = 0; //where the next sample of every branch goes, 0..tapsPerBranch-1
+    std::vector<float> branchCoefficients; //factor x tapsPerBranch, oldest first
+    std::vector<float> branchLines; //factor x 2*tapsPerBranch, each one written twice
+};
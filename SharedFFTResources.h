@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    SharedFFTResources.h
+    FFT plans and window tables shared by every tuner in the process.
+
+    A template with a tuner on every channel strip loads 100+ instances, and
+    each one used to build its own juce::dsp::FFT and its own 8192 entry
+    Blackman-Harris table per FFT order. They never change after they're
+    built, so now there's 1 of each per (order) and per (size, window type),
+    reference counted with shared_ptr. The cache only keeps weak_ptrs, so
+    the last instance to let go of one frees it.
+
+    juce::dsp::FFT's perform functions are const and keep no state between
+    calls, so one plan can be used from any number of analysis threads at
+    once. The same goes for low memory mode's PackedRealFFT plans. Getting
+    a plan locks, so only do it when preparing, never on the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PackedRealFFT.h"
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class SharedFFTResources
+{
+public:
+    using WindowType = juce::dsp::WindowingFunction<float>::WindowingMethod;
+
+    static std::shared_ptr<const juce::dsp::FFT> getFFT(int order)
+    {
+        auto& cache = getInstance();
+        const juce::ScopedLock sl (cache.lock);
+
+        auto& cached = cache.fftPlans[order];
+        if (auto plan = cached.lock())
+        {
+            return plan;
+        }
+
+        auto plan = std::make_shared<const juce::dsp::FFT>(order);
+        cached = plan;
+        ++cache.numFFTPlansBuilt;
+        return plan;
+    }
+
+    //The in place FFT low memory mode uses (PackedRealFFT.h)
+    static std::shared_ptr<const PackedRealFFT> getPackedRealFFT(int order)
+    {
+        auto& cache = getInstance();
+        const juce::ScopedLock sl (cache.lock);
+
+        auto& cached = cache.packedRealFFTPlans[order];
+        if (auto plan = cached.lock())
+        {
+            return plan;
+        }
+
+        auto plan = std::make_shared<const PackedRealFFT>(order);
+        cached = plan;
+        ++cache.numFFTPlansBuilt;
+        return plan;
+    }
+
+    //Normalised, like fillWindowingTables(..., normalise = true)
+    static std::shared_ptr<const std::vector<float>> getWindow(int size, WindowType type)
+    {
+        auto& cache = getInstance();
+        const juce::ScopedLock sl (cache.lock);
+
+        auto& cached = cache.windowTables[std::make_pair(size, static_cast<int>(type))];
+        if (auto table = cached.lock())
+        {
+            return table;
+        }
+
+        auto newTable = std::make_shared< std::vector<float> >(static_cast<size_t>(size));
+        juce::dsp::WindowingFunction<float>::fillWindowingTables(newTable->data(), static_cast<size_t>(size), type, true);
+        std::shared_ptr<const std::vector<float>> table = std::move(newTable);
+        cached = table;
+        ++cache.numWindowTablesBuilt;
+        return table;
+    }
+
+    //What's alive right now, and how much had to be built since the process started (a plan that was freed and asked for again counts twice)
+    struct Stats
+    {
+        int numFFTPlans = 0;
+        int numWindowTables = 0;
+        size_t windowTableBytes = 0;
+        int numFFTPlansBuilt = 0;
+        int numWindowTablesBuilt = 0;
+    };
+
+    static Stats getStats()
+    {
+        auto& cache = getInstance();
+        const juce::ScopedLock sl (cache.lock);
+
+        Stats stats;
+        for (const auto& entry : cache.fftPlans)
+        {
+            stats.numFFTPlans += entry.second.expired() ? 0 : 1;
+        }
+        for (const auto& entry : cache.packedRealFFTPlans)
+        {
+            stats.numFFTPlans += entry.second.expired() ? 0 : 1;
+        }
+        for (const auto& entry : cache.windowTables)
+        {
+            if (auto table = entry.second.lock())
+            {
+                ++stats.numWindowTables;
+                stats.windowTableBytes += table->size()*sizeof(float);
+            }
+        }
+        stats.numFFTPlansBuilt = cache.numFFTPlansBuilt;
+        stats.numWindowTablesBuilt = cache.numWindowTablesBuilt;
+        return stats;
+    }
+
+private:
+    static SharedFFTResources& getInstance()
+    {
+        static SharedFFTResources instance; //1 per loaded plugin binary, so every instance the host makes of it shares it
+        return instance;
+    }
+
+    juce::CriticalSection lock;
+    std::map< int, std::weak_ptr<const juce::dsp::FFT> > fftPlans; //by order
+    std::map< int, std::weak_ptr<const PackedRealFFT> > packedRealFFTPlans; //by order
+    std::map< std::pair<int, int>, std::weak_ptr<const std::vector<float>> > windowTables; //by (size, window type)
+    int numFFTPlansBuilt = 0, numWindowTablesBuilt = 0;
+};
@@ -0,0 +1,118 @@
+/*
+  ==============================================================================
+
+    SlidingDFTTracker.h
+    Narrowband tracker for when the tuner is locked onto a note.
+    Instead of a full FFT every hop, a sliding DFT keeps a handful of bins
+    around the locked peak up to date, one sample at a time, in O(bins).
+
+    The bins have the same time origin (the oldest sample of the history) as
+    the FFT frames, so the phase-difference estimator works on them unchanged.
+    The Blackman-Harris window is applied in the frequency domain: the 4 term
+    window is a 7 bin kernel, so we keep 3 extra raw bins on each side.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+class SlidingDFTTracker
+{
+public:
+    static constexpr int numTrackedBins = 5; //windowed bins we can read: the locked bin +-2
+    static constexpr int kernelHalfWidth = 3; //Blackman-Harris spreads each bin over +-3 bins
+    static constexpr int numRawBins = numTrackedBins + 2*kernelHalfWidth;
+    static constexpr int centreIndex = numTrackedBins/2;
+
+    void prepare(int fftSizeToUse)
+    {
+        fftSize = fftSizeToUse;
+        unlock();
+    }
+
+    //Starts tracking around centreBin. Initialises the raw bins with a direct DFT of the circular history: O(fftSize*numRawBins), once per lock.
+    //The history can be longer than fftSize. windowStartIndex is where our fftSize window starts in it
+    void lock(int centreBin, const float* circularHistory, int historySize, int windowStartIndex)
+    {
+        firstBin = centreBin - centreIndex - kernelHalfWidth;
+        locked = true;
+
+        for (int i = 0; i < numRawBins; ++i)
+        {
+            const double omega = juce::MathConstants<double>::twoPi*(firstBin+i)/fftSize;
+            twiddleReal[i] = std::cos(omega);
+            twiddleImag[i] = std::sin(omega);
+
+            //e^(-j*omega*n), rotated one sample at a time. Double is plenty accurate for one pass over the window
+            double re = 0, im = 0, rotReal = 1, rotImag = 0;
+            for (int n = 0; n < fftSize; ++n)
+            {
+                const double x = circularHistory[(windowStartIndex+n) % historySize];
+                re += x*rotReal;
+                im += x*rotImag;
+                const double nextReal = rotReal*twiddleReal[i] + rotImag*twiddleImag[i];
+                rotImag = rotImag*twiddleReal[i] - rotReal*twiddleImag[i];
+                rotReal = nextReal;
+            }
+            rawReal[i] = re;
+            rawImag[i] = im;
+        }
+    }
+
+    void unlock() { locked = false; }
+    bool isLocked() const { return locked; }
+    int getCentreBin() const { return firstBin + kernelHalfWidth + centreIndex; }
+
+    //Slides the window by numSamples. oldSamples are the ones falling out of the window, ie. what the history had where newSamples go.
+    //X_k(n) = (X_k(n-1) + x(n) - x(n-N)) * e^(j*2pi*k/N)
+    void processSamples(const float* newSamples, const float* oldSamples, int numSamples)
+    {
+        jassert(locked);
+        for (int n = 0; n < numSamples; ++n)
+        {
+            const double delta = static_cast<double>(newSamples[n]) - oldSamples[n];
+            for (int i = 0; i < numRawBins; ++i) //small fixed trip count, the compiler unrolls/vectorises this
+            {
+                const double re = rawReal[i] + delta;
+                const double im = rawImag[i];
+                rawReal[i] = re*twiddleReal[i] - im*twiddleImag[i];
+                rawImag[i] = re*twiddleImag[i] + im*twiddleReal[i];
+            }
+        }
+    }
+
+    //The windowed bins (locked bin +-2) in the same layout as an FFT frame: even index = real, odd index = imag.
+    //Scaled like FFTDataGenerator's normalised window, so magnitudes can be compared to the FFT's
+    void getWindowedBins(std::array<float, numTrackedBins*2>& interleaved) const
+    {
+        //Periodic 4 term Blackman-Harris: a0 - a1*cos + a2*cos2 - a3*cos3. Each cos term is half a bin's worth on each neighbour
+        constexpr double a0 = 0.35875, a1 = 0.48829, a2 = 0.14128, a3 = 0.01168;
+        constexpr double kernel[kernelHalfWidth+1] = { 1.0, -0.5*a1/a0, 0.5*a2/a0, -0.5*a3/a0 };
+
+        for (int t = 0; t < numTrackedBins; ++t)
+        {
+            const int centre = t + kernelHalfWidth;
+            double re = kernel[0]*rawReal[centre];
+            double im = kernel[0]*rawImag[centre];
+            for (int offset = 1; offset <= kernelHalfWidth; ++offset)
+            {
+                re += kernel[offset]*(rawReal[centre-offset] + rawReal[centre+offset]);
+                im += kernel[offset]*(rawImag[centre-offset] + rawImag[centre+offset]);
+            }
+            interleaved[2*t] = static_cast<float>(re);
+            interleaved[2*t+1] = static_cast<float>(im);
+        }
+    }
+
+private:
+    int fftSize = 0;
+    int firstBin = 0; //the bin number of rawReal[0]/rawImag[0]
+    bool locked = false;
+
+    std::array<double, numRawBins> rawReal {}, rawImag {}; //unwindowed DFT bins firstBin..firstBin+numRawBins-1
+    std::array<double, numRawBins> twiddleReal {}, twiddleImag {};
+};
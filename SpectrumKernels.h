@@ -0,0 +1,253 @@
+/*
+  ==============================================================================
+
+    SpectrumKernels.h
+    Vectorised helpers for the peak search in findComplexMaxIndex.
+    They work on squared magnitudes (no sqrt, no hypot).
+    dotProduct is the inner loop of the decimator's FIR (PolyphaseDecimator.h).
+
+    The instruction set is picked at compile time:
+        AVX2 when the compiler targets it (eg. -mavx2 / /arch:AVX2),
+        SSE2 on every other x86-64 build,
+        NEON on 64 bit ARM (Apple Silicon),
+        plain C++ everywhere else.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+ #include <immintrin.h>
+ #define SPECTRUM_KERNELS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define SPECTRUM_KERNELS_SSE2 1
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+ #include <arm_neon.h>
+ #define SPECTRUM_KERNELS_NEON 1
+#endif
+
+namespace SpectrumKernels
+{
+
+//Scalar versions. Used for the tails of the SIMD loops and on platforms without SIMD
+inline float computeSquaredMagnitudesScalar(const float* interleaved, float* magnitudesSquared, int startBin, int endBin, float maxSoFar)
+{
+    for (int bin = startBin; bin < endBin; ++bin)
+    {
+        const float re = interleaved[2*bin], im = interleaved[2*bin+1];
+        magnitudesSquared[bin] = re*re + im*im;
+        maxSoFar = std::max(maxSoFar, magnitudesSquared[bin]);
+    }
+    return maxSoFar;
+}
+
+inline float computeSquaredMagnitudesScalar(const float* real, const float* imag, float* magnitudesSquared, int startBin, int endBin, float maxSoFar)
+{
+    for (int bin = startBin; bin < endBin; ++bin)
+    {
+        magnitudesSquared[bin] = real[bin]*real[bin] + imag[bin]*imag[bin];
+        maxSoFar = std::max(maxSoFar, magnitudesSquared[bin]);
+    }
+    return maxSoFar;
+}
+
+//Fills magnitudesSquared[0..numBins) from interleaved complex data (even index = real, odd index = imag, like juce::dsp::FFT's output)
+//and returns the largest value
+inline float computeSquaredMagnitudes(const float* interleaved, float* magnitudesSquared, int numBins)
+{
+    int bin = 0;
+    float maxValue = 0;
+
+   #if SPECTRUM_KERNELS_AVX2
+    __m256 maxVector = _mm256_setzero_ps();
+    for (; bin + 8 <= numBins; bin += 8)
+    {
+        const __m256 a = _mm256_loadu_ps(interleaved + 2*bin);     //re0 im0 re1 im1 | re2 im2 re3 im3
+        const __m256 b = _mm256_loadu_ps(interleaved + 2*bin + 8); //re4 im4 re5 im5 | re6 im6 re7 im7
+        const __m256 a2 = _mm256_mul_ps(a, a);
+        const __m256 b2 = _mm256_mul_ps(b, b);
+        //shuffle_ps works inside each 128 bit lane, so this gives bins 0 1 4 5 | 2 3 6 7
+        const __m256 re2 = _mm256_shuffle_ps(a2, b2, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 im2 = _mm256_shuffle_ps(a2, b2, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 sum = _mm256_add_ps(re2, im2);
+        //put the 64 bit pairs back in bin order: 0 1 2 3 | 4 5 6 7
+        const __m256 ordered = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sum), _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(magnitudesSquared + bin, ordered);
+        maxVector = _mm256_max_ps(maxVector, ordered);
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, maxVector);
+    maxValue = *std::max_element(lanes, lanes+8);
+   #elif SPECTRUM_KERNELS_SSE2
+    __m128 maxVector = _mm_setzero_ps();
+    for (; bin + 4 <= numBins; bin += 4)
+    {
+        const __m128 a = _mm_loadu_ps(interleaved + 2*bin);     //re0 im0 re1 im1
+        const __m128 b = _mm_loadu_ps(interleaved + 2*bin + 4); //re2 im2 re3 im3
+        const __m128 a2 = _mm_mul_ps(a, a);
+        const __m128 b2 = _mm_mul_ps(b, b);
+        const __m128 sum = _mm_add_ps(_mm_shuffle_ps(a2, b2, _MM_SHUFFLE(2, 0, 2, 0)),  //re^2 of bins 0 1 2 3
+                                      _mm_shuffle_ps(a2, b2, _MM_SHUFFLE(3, 1, 3, 1))); //im^2 of bins 0 1 2 3
+        _mm_storeu_ps(magnitudesSquared + bin, sum);
+        maxVector = _mm_max_ps(maxVector, sum);
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, maxVector);
+    maxValue = *std::max_element(lanes, lanes+4);
+   #elif SPECTRUM_KERNELS_NEON
+    float32x4_t maxVector = vdupq_n_f32(0);
+    for (; bin + 4 <= numBins; bin += 4)
+    {
+        const float32x4x2_t reIm = vld2q_f32(interleaved + 2*bin); //deinterleaves for us: val[0] = re, val[1] = im
+        const float32x4_t sum = vmlaq_f32(vmulq_f32(reIm.val[0], reIm.val[0]), reIm.val[1], reIm.val[1]);
+        vst1q_f32(magnitudesSquared + bin, sum);
+        maxVector = vmaxq_f32(maxVector, sum);
+    }
+    float lanes[4];
+    vst1q_f32(lanes, maxVector);
+    maxValue = *std::max_element(lanes, lanes+4);
+   #endif
+
+    return computeSquaredMagnitudesScalar(interleaved, magnitudesSquared, bin, numBins, maxValue);
+}
+
+//Same as above for a split layout (separate real and imag arrays)
+inline float computeSquaredMagnitudes(const float* real, const float* imag, float* magnitudesSquared, int numBins)
+{
+    int bin = 0;
+    float maxValue = 0;
+
+   #if SPECTRUM_KERNELS_AVX2
+    __m256 maxVector = _mm256_setzero_ps();
+    for (; bin + 8 <= numBins; bin += 8)
+    {
+        const __m256 re = _mm256_loadu_ps(real + bin);
+        const __m256 im = _mm256_loadu_ps(imag + bin);
+        const __m256 sum = _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im));
+        _mm256_storeu_ps(magnitudesSquared + bin, sum);
+        maxVector = _mm256_max_ps(maxVector, sum);
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, maxVector);
+    maxValue = *std::max_element(lanes, lanes+8);
+   #elif SPECTRUM_KERNELS_SSE2
+    __m128 maxVector = _mm_setzero_ps();
+    for (; bin + 4 <= numBins; bin += 4)
+    {
+        const __m128 re = _mm_loadu_ps(real + bin);
+        const __m128 im = _mm_loadu_ps(imag + bin);
+        const __m128 sum = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+        _mm_storeu_ps(magnitudesSquared + bin, sum);
+        maxVector = _mm_max_ps(maxVector, sum);
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, maxVector);
+    maxValue = *std::max_element(lanes, lanes+4);
+   #elif SPECTRUM_KERNELS_NEON
+    float32x4_t maxVector = vdupq_n_f32(0);
+    for (; bin + 4 <= numBins; bin += 4)
+    {
+        const float32x4_t re = vld1q_f32(real + bin);
+        const float32x4_t im = vld1q_f32(imag + bin);
+        const float32x4_t sum = vmlaq_f32(vmulq_f32(re, re), im, im);
+        vst1q_f32(magnitudesSquared + bin, sum);
+        maxVector = vmaxq_f32(maxVector, sum);
+    }
+    float lanes[4];
+    vst1q_f32(lanes, maxVector);
+    maxValue = *std::max_element(lanes, lanes+4);
+   #endif
+
+    return computeSquaredMagnitudesScalar(real, imag, magnitudesSquared, bin, numBins, maxValue);
+}
+
+//Returns the first index in [start, end) where values[index] >= threshold, or end if there isn't one
+inline int findFirstAtLeast(const float* values, int start, int end, float threshold)
+{
+    int index = start;
+
+   #if SPECTRUM_KERNELS_AVX2
+    const __m256 thresholdVector = _mm256_set1_ps(threshold);
+    for (; index + 8 <= end; index += 8)
+    {
+        const int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + index), thresholdVector, _CMP_GE_OQ));
+        if (mask != 0)
+        {
+            break; //the scalar loop below finds the exact lane
+        }
+    }
+   #elif SPECTRUM_KERNELS_SSE2
+    const __m128 thresholdVector = _mm_set1_ps(threshold);
+    for (; index + 4 <= end; index += 4)
+    {
+        if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(values + index), thresholdVector)) != 0)
+        {
+            break;
+        }
+    }
+   #elif SPECTRUM_KERNELS_NEON
+    const float32x4_t thresholdVector = vdupq_n_f32(threshold);
+    for (; index + 4 <= end; index += 4)
+    {
+        if (vmaxvq_u32(vcgeq_f32(vld1q_f32(values + index), thresholdVector)) != 0)
+        {
+            break;
+        }
+    }
+   #endif
+
+    for (; index < end; ++index)
+    {
+        if (values[index] >= threshold)
+        {
+            return index;
+        }
+    }
+    return end;
+}
+
+//Sum of a[i]*b[i] over [0, size). The lanes are summed at the end, so the rounding differs a little from the plain loop
+inline float dotProduct(const float* a, const float* b, int size)
+{
+    int index = 0;
+    float sum = 0;
+
+   #if SPECTRUM_KERNELS_AVX2
+    __m256 sumVector = _mm256_setzero_ps();
+    for (; index + 8 <= size; index += 8)
+    {
+        sumVector = _mm256_add_ps(sumVector, _mm256_mul_ps(_mm256_loadu_ps(a + index), _mm256_loadu_ps(b + index)));
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, sumVector);
+    for (float lane : lanes) { sum += lane; }
+   #elif SPECTRUM_KERNELS_SSE2
+    __m128 sumVector = _mm_setzero_ps();
+    for (; index + 4 <= size; index += 4)
+    {
+        sumVector = _mm_add_ps(sumVector, _mm_mul_ps(_mm_loadu_ps(a + index), _mm_loadu_ps(b + index)));
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, sumVector);
+    for (float lane : lanes) { sum += lane; }
+   #elif SPECTRUM_KERNELS_NEON
+    float32x4_t sumVector = vdupq_n_f32(0);
+    for (; index + 4 <= size; index += 4)
+    {
+        sumVector = vmlaq_f32(sumVector, vld1q_f32(a + index), vld1q_f32(b + index));
+    }
+    sum = vaddvq_f32(sumVector);
+   #endif
+
+    for (; index < size; ++index)
+    {
+        sum += a[index]*b[index];
+    }
+    return sum;
+}
+
+} //namespace SpectrumKernels
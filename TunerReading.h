@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    TunerReading.h
+    The reading the analysis publishes (TunerReading), and the seqlock it's
+    published through (SeqlockSnapshot).
+
+    A TunerReading is everything about 1 analysis frame in 1 plain struct:
+    frequency, peak magnitude, confidence, note, cents and the sample time.
+    It's written once per frame, all together, so a reader never gets the
+    frequency of one frame with the magnitude or the cents of another.
+
+    SeqlockSnapshot: the writer bumps a sequence number to odd, writes the
+    words, and bumps it to even again. A reader copies the words and keeps
+    the copy only if the sequence was even and didn't change while it was
+    copying. The writer never waits, readers never block the writer, and
+    nothing allocates, so there can be any number of readers on any thread.
+    The words are relaxed atomics, so a torn copy is thrown away instead of
+    being undefined behaviour.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+struct TunerReading
+{
+    float frequency = -1.f; //Hz. -1 = no reading yet, 0 = below the noise threshold/unpitched
+    float peakMagnitude = 0.f; //same scale as PitchReading::magnitude
+    float confidence = 0.f; //0..1, from the estimator (PitchReading::confidence)
+    int noteIndex = -1; //0 = C ... 11 = B, -1 without a pitch
+    int midiNote = -1; //-1 without a pitch
+    float cents = 0.f; //away from the target of midiNote, with the NoteMapper the processor had for this frame
+    juce::int64 sampleTime = 0; //stream position (since prepareToPlay) just after the newest sample the reading used
+    int windowLength = 0; //samples of history behind the reading
+    int fftOrder = 0; //the FFT order it came from (fftPhaseVocoder)
+
+    bool hasPitch() const noexcept { return frequency > 0.f && noteIndex >= 0; }
+};
+
+//1 writer at a time (per snapshot), any number of readers. Type has to be trivially copyable
+template<typename Type>
+class SeqlockSnapshot
+{
+public:
+    SeqlockSnapshot() { write(Type()); }
+
+    void write(const Type& value) noexcept
+    {
+        std::array<Word, numWords> words {};
+        std::memcpy(words.data(), &value, sizeof(Type));
+
+        const juce::uint32 sequenceBefore = sequence.load(std::memory_order_relaxed);
+        sequence.store(sequenceBefore+1, std::memory_order_relaxed); //odd: writing
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < numWords; ++i)
+        {
+            data[i].store(words[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(sequenceBefore+2, std::memory_order_release);
+    }
+
+    //1 attempt. False if the writer was in the middle of a write, then value is left alone (eg. for the audio thread, which can't spin)
+    bool tryRead(Type& value, juce::uint32* version = nullptr) const noexcept
+    {
+        const juce::uint32 sequenceBefore = sequence.load(std::memory_order_acquire);
+        if ((sequenceBefore & 1) != 0)
+        {
+            return false;
+        }
+
+        std::array<Word, numWords> words;
+        for (size_t i = 0; i < numWords; ++i)
+        {
+            words[i] = data[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) != sequenceBefore)
+        {
+            return false;
+        }
+
+        std::memcpy(static_cast<void*>(&value), words.data(), sizeof(Type)); //trivially copyable, but not trivial (default member initialisers)
+        if (version != nullptr)
+        {
+            *version = sequenceBefore/2;
+        }
+        return true;
+    }
+
+    //Retries until it gets a whole copy. A write is a few dozen stores, so that's almost never more than once
+    Type read(juce::uint32* version = nullptr) const noexcept
+    {
+        Type value;
+        while (! tryRead(value, version))
+        {
+        }
+        return value;
+    }
+
+    //Goes up by 1 with every write. A cheap way to see if there's anything new before copying it
+    juce::uint32 getVersion() const noexcept { return sequence.load(std::memory_order_acquire)/2; }
+
+private:
+    static_assert(std::is_trivially_copyable<Type>::value, "SeqlockSnapshot copies its type as words");
+
+    using Word = juce::uint32; //lock free on every target, 64 bit atomics aren't on 32 bit ones
+    static constexpr size_t numWords = (sizeof(Type) + sizeof(Word) - 1)/sizeof(Word);
+
+    std::atomic<juce::uint32> sequence {0};
+    std::array<std::atomic<Word>, numWords> data {};
+};
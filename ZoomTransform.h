@@ -0,0 +1,113 @@
+/*
+  ==============================================================================
+
+    ZoomTransform.h
+    Sub-bin refinement of a spectral peak: the DTFT of the windowed frame on
+    a fine grid around the FFT's peak bin (a zoom FFT/chirp-Z transform over
+    a narrow band), so a short FFT can still place the peak to a fraction of
+    a cent.
+
+    The FFT only samples the spectrum every sampleRate/N Hz. Between the
+    bins the window's main lobe is smooth, so the zoom evaluates numPoints
+    frequencies 1/8 bin apart over +-1 bin around the coarse peak, and a
+    parabola through the biggest one and its neighbours (on the log
+    magnitude, where a Blackman-Harris lobe is very nearly a parabola) finds
+    the top. A second, finer pass changed nothing measurable: what's left is
+    the other partials' leakage, not the grid.
+
+    With this few points a direct evaluation is cheaper than a Bluestein
+    chirp-Z (3 FFTs of 2N). Each point is a Goertzel resonator, 1 multiply
+    and 2 adds per sample, in double. The points run side by side so the
+    compiler can vectorise across them, and as the recursion's latency is
+    the limit, 17 points cost about what 9 do.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+#include <limits>
+
+class ZoomTransform
+{
+public:
+    static constexpr int numPoints = 17; //odd, so the middle one is on coarseBin
+    static constexpr double halfWidthBins = 1.0; //a sine's biggest bin is never more than half a bin from it, plus some slack
+    static constexpr double binStep = 2.0*halfWidthBins/(numPoints-1); //1/8 bin
+
+    //Where the main lobe around coarseBin peaks, in (fractional) bins of a size point FFT. The frame is size samples of a
+    //circular history from startIndex, multiplied by window as it's read, so nothing is copied. Costs numPoints*size resonator steps
+    static double findPeakBin(const float* history, int historySize, int startIndex, const float* window, int size, double coarseBin)
+    {
+        const double firstBin = coarseBin - halfWidthBins;
+        std::array<double, numPoints> magnitudesSquared;
+        evaluate(history, historySize, startIndex, window, size, firstBin, magnitudesSquared);
+
+        int maxPoint = 0;
+        for (int k = 1; k < numPoints; ++k)
+        {
+            if (magnitudesSquared[static_cast<size_t>(k)] > magnitudesSquared[static_cast<size_t>(maxPoint)])
+            {
+                maxPoint = k;
+            }
+        }
+        maxPoint = juce::jlimit(1, numPoints-2, maxPoint); //on the edge the top is outside the grid, the parabola extrapolates a bit
+
+        const double left = logLevel(magnitudesSquared[static_cast<size_t>(maxPoint-1)]);
+        const double middle = logLevel(magnitudesSquared[static_cast<size_t>(maxPoint)]);
+        const double right = logLevel(magnitudesSquared[static_cast<size_t>(maxPoint+1)]);
+        const double curvature = left - 2.0*middle + right;
+        const double offset = (curvature < 0.0) ? juce::jlimit(-1.0, 1.0, 0.5*(left-right)/curvature) : 0.0;
+
+        return firstBin + (maxPoint + offset)*binStep;
+    }
+
+private:
+    //|DTFT|^2 of the windowed frame at firstBin, firstBin+binStep... (numPoints of them)
+    static void evaluate(const float* history, int historySize, int startIndex, const float* window, int size,
+                         double firstBin, std::array<double, numPoints>& magnitudesSquared)
+    {
+        std::array<double, numPoints> coefficients, twoMinusCoefficients, state1 {}, state2 {};
+        for (int k = 0; k < numPoints; ++k)
+        {
+            const double halfOmega = juce::MathConstants<double>::pi*(firstBin + k*binStep)/size;
+            twoMinusCoefficients[static_cast<size_t>(k)] = 4.0*std::sin(halfOmega)*std::sin(halfOmega); //2 - 2cos(omega), without the cancellation
+            coefficients[static_cast<size_t>(k)] = 2.0 - twoMinusCoefficients[static_cast<size_t>(k)];
+        }
+
+        const int numSamplesInFirstSegment = juce::jmin(size, historySize-startIndex);
+        resonate(history+startIndex, window, numSamplesInFirstSegment, coefficients, state1, state2);
+        resonate(history, window+numSamplesInFirstSegment, size-numSamplesInFirstSegment, coefficients, state1, state2);
+
+        for (int k = 0; k < numPoints; ++k)
+        {
+            //s1^2 + s2^2 - c*s1*s2, rearranged so it doesn't cancel when c is close to 2 (the low bins)
+            const auto i = static_cast<size_t>(k);
+            const double difference = state1[i] - state2[i];
+            magnitudesSquared[i] = difference*difference + twoMinusCoefficients[i]*state1[i]*state2[i];
+        }
+    }
+
+    static void resonate(const float* samples, const float* window, int numSamples, const std::array<double, numPoints>& coefficients,
+                         std::array<double, numPoints>& state1, std::array<double, numPoints>& state2)
+    {
+        for (int n = 0; n < numSamples; ++n)
+        {
+            const double x = static_cast<double>(samples[n]*window[n]);
+            for (size_t k = 0; k < static_cast<size_t>(numPoints); ++k)
+            {
+                const double newState = x + coefficients[k]*state1[k] - state2[k];
+                state2[k] = state1[k];
+                state1[k] = newState;
+            }
+        }
+    }
+
+    static double logLevel(double magnitudeSquared)
+    {
+        return std::log(juce::jmax(magnitudeSquared, std::numeric_limits<double>::min()));
+    }
+};